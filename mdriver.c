@@ -16,6 +16,11 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -30,9 +35,10 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define RSS_EVERY     32 /* requests between samples of the resident set */
 
-/* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
+/* Returns true if p is a-byte aligned */
+#define IS_ALIGNED(p, a)  ((((uintptr_t)(p)) % (a)) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -47,9 +53,12 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, BATCH_ALLOC, BATCH_FREE,
+	  SIZED_FREE, GROW, MEMALIGN, CALLOC} type; /* type of request */
     int index;                        /* index for free() to use later */
     int size;                         /* byte size of alloc/realloc request */
+    int count;                        /* blocks in a batch, from index on */
+    int align;                        /* alignment of a memalign request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -57,10 +66,12 @@ typedef struct {
     unsigned sugg_heapsize;   /* suggested heap size (unused) */
     unsigned num_ids;         /* number of alloc/realloc ids */
     unsigned num_ops;         /* number of distinct requests */
+    unsigned num_blocks;      /* requests, counting every block of a batch */
     unsigned weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void **batch;        /* scratch array handed to mm_free_batch */
 } trace_t;
 
 /* 
@@ -73,6 +84,23 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Summarizes the heap footprint of the student's malloc package over a trace */
+typedef struct {
+    size_t peak;     /* largest heap size at any point */
+    double mean;     /* heap size after each request, averaged over the trace */
+    size_t final;    /* heap size after the last request */
+    unsigned long grows; /* times a heap grew during the trace */
+    size_t rss_peak; /* largest resident set of the heap and mappings */
+    double rss_mean; /* resident set, averaged over its samples */
+    mm_stats_t heap; /* heap counters when the live bytes peaked */
+} footprint_t;
+
+/* Counts the TLB and page-fault cost of one run of a trace */
+typedef struct {
+    long misses;     /* dTLB load misses, or -1 if they cannot be counted */
+    long faults;     /* minor and major page faults */
+} tlb_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -82,6 +110,10 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    mm_cache_stats_t cache; /* cache counters after the utilization run */
+    footprint_t footprint;  /* heap footprint during the utilization run */
+    mm_instrument_t inst;   /* hot-path counters after the utilization run */
+    tlb_t tlb[2];           /* a run without and with huge pages (-T) */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -90,6 +122,10 @@ typedef struct {
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
+static int sized_free = 0; /* If set, run every free as a sized free (-z) */
+static int grow = 0;       /* If set, run every realloc as a grow (-u) */
+static int zeroed = 0;     /* If set, run every alloc as a calloc (-C) */
+static int check_every = 0; /* If set, check the mm heap every n requests (-k) */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
@@ -107,7 +143,7 @@ static char *default_tracefiles[] = {
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, int size, int align,
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
@@ -123,11 +159,19 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_limits(int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   footprint_t *footprint);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_tlb(speed_t *params, tlb_t *tlb);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcachestats(int n, stats_t *stats);
+static void printfootprint(int n, stats_t *stats);
+static void printheapstats(int n, stats_t *stats);
+static void printinstrument(int n, stats_t *stats);
+static void printtlb(int n, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -151,6 +195,14 @@ int main(int argc, char **argv)
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int cache_stats = 0; /* If set, print the mm cache counters (set by -c) */
+    int footprint = 0;   /* If set, print the mm heap footprint (set by -m) */
+    int heap_stats = 0;  /* If set, print the mm heap counters (set by -S) */
+    int instrumented = 0; /* Was mm.c built with MM_INSTRUMENT? */
+    size_t region_mb = 0; /* Size of every memlib region in MB (set by -M) */
+    size_t limit_mb = 0;  /* Most MB that memlib may commit (set by -L) */
+    int hugepages = 1;    /* If set, use huge pages (reset by -H) */
+    int tlb_stats = 0;    /* If set, print the TLB misses and page faults (-T) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -159,7 +211,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:k:M:L:hvVgalcmSzuCGHT")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -179,12 +231,54 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+        case 'k': /* Check the mm heap every n requests */
+            check_every = atoi(optarg);
+            if (check_every < 1)
+                app_error("mdriver: -k needs a positive request count");
+            break;
+        case 'M': /* Size of every memlib region in MB */
+            if (atol(optarg) < 1)
+                app_error("mdriver: -M needs a positive size in MB");
+            region_mb = atol(optarg);
+            break;
+        case 'L': /* Most MB that memlib may commit */
+            if (atol(optarg) < 1)
+                app_error("mdriver: -L needs a positive size in MB");
+            limit_mb = atol(optarg);
+            break;
+        case 'H': /* Don't use huge pages */
+            hugepages = 0;
+            break;
+        case 'T': /* Print the TLB misses and page faults of mm malloc */
+            tlb_stats = 1;
+            break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'c': /* Print the mm cache counters */
+            cache_stats = 1;
+            break;
+        case 'm': /* Print the mm heap footprint */
+            footprint = 1;
+            break;
+        case 'S': /* Print the mm heap counters */
+            heap_stats = 1;
+            break;
+        case 'z': /* Free with mm_free_sized */
+            sized_free = 1;
+            break;
+        case 'u': /* Grow blocks within mm_usable_size before reallocating */
+            grow = 1;
+            break;
+        case 'C': /* Allocate with mm_calloc */
+            zeroed = 1;
+            break;
+        case 'G': /* Grow the heap adaptively */
+            mm_set_growth(MM_GROW_ADAPTIVE);
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -254,7 +348,7 @@ int main(int argc, char **argv)
 	/* Evaluate the libc malloc package using the K-best scheme */
 	for (i=0; i < num_tracefiles; i++) {
 	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
+	    libc_stats[i].ops = trace->num_blocks;
 	    if (verbose > 1)
 		printf("Checking libc malloc for correctness, ");
 	    libc_stats[i].valid = eval_libc_valid(trace, i);
@@ -286,24 +380,37 @@ int main(int argc, char **argv)
 	unix_error("mm_stats calloc in main failed");
     
     /* Initialize the simulated memory system in memlib.c */
+    mem_set_limits(region_mb << 20, limit_mb << 20);
+    mem_set_hugepages(hugepages);
+    mem_track_mappings(1);
     mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
 	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
+	mm_stats[i].ops = trace->num_blocks;
 	if (verbose > 1)
 	    printf("Checking mm_malloc for correctness, ");
 	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
 	if (mm_stats[i].valid) {
 	    if (verbose > 1)
 		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    mm_stats[i].util = eval_mm_util(trace, i, &ranges,
+					    &mm_stats[i].footprint);
+	    mm_get_cache_stats(&mm_stats[i].cache);
+	    instrumented = (mm_get_instrument(&mm_stats[i].inst) == 0);
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    if (tlb_stats) {
+		mem_set_hugepages(0);
+		eval_mm_tlb(&speed_params, &mm_stats[i].tlb[0]);
+		mem_set_hugepages(1);
+		eval_mm_tlb(&speed_params, &mm_stats[i].tlb[1]);
+		mem_set_hugepages(hugepages);
+	    }
 	}
 	free_trace(trace);
     }
@@ -313,6 +420,31 @@ int main(int argc, char **argv)
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
+	if (instrumented) {
+	    printf("\nHot-path counters of mm malloc:\n");
+	    printinstrument(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
+    }
+    if (cache_stats) {
+	printf("\nCache counters for mm malloc:\n");
+	printcachestats(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (footprint) {
+	printf("\nHeap footprint of mm malloc:\n");
+	printfootprint(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (heap_stats) {
+	printf("\nHeap counters of mm malloc at the peak of live data:\n");
+	printheapstats(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (tlb_stats) {
+	printf("\nTLB misses and page faults of mm malloc with 4 KB and 2 MB pages:\n");
+	printtlb(num_tracefiles, mm_stats);
+	printf("\n");
     }
 
     /* 
@@ -376,10 +508,11 @@ int main(int argc, char **argv)
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
- *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     size bytes at addr lo, which must be aligned to align bytes. After
+ *     checking the block for correctness, we create a range struct for
+ *     this block and add it to the range list. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, int size, int align,
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
@@ -388,18 +521,21 @@ static int add_range(range_t **ranges, char *lo, int size,
 
     assert(size > 0);
 
-    /* Payload addresses must be ALIGNMENT-byte aligned */
-    if (!IS_ALIGNED(lo)) {
+    /* Payload addresses must be ALIGNMENT-byte aligned, or more if asked */
+    if (align < ALIGNMENT)
+	align = ALIGNMENT;
+    if (!IS_ALIGNED(lo, align)) {
 	sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
-		lo, ALIGNMENT);
+		lo, align);
         malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
-	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
+    /* The payload must lie within the extent of the heap, or of a mapping */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_mapped(lo, size)) {
+	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p) and mappings",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
@@ -478,7 +614,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, count, align;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -515,36 +651,98 @@ static trace_t *read_trace(char *tracedir, char *filename)
     if ((trace->block_sizes = 
 	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
 	unix_error("malloc 4 failed in read_trace");
+
+    /* ... and room to hand a batch of them to mm_free_batch */
+    if ((trace->batch = 
+	 (void **)malloc(trace->num_ids * sizeof(void *))) == NULL)
+	unix_error("malloc 5 failed in read_trace");
     
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
+    trace->num_blocks = 0;
     while (fscanf(tracefile, "%s", type) != EOF) {
 	switch(type[0]) {
 	case 'a':
 	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
+	    trace->ops[op_index].type = zeroed ? CALLOC : ALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'r':
 	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
+	    trace->ops[op_index].type = grow ? GROW : REALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'f':
 	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
+	    trace->ops[op_index].type = sized_free ? SIZED_FREE : FREE;
+	    trace->ops[op_index].index = index;
+	    break;
+	case 'g': /* "g index size" reallocates only past the usable size */
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = GROW;
 	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'm': /* "m index align size" allocates an aligned block */
+	    fscanf(tracefile, "%u %u %u", &index, &align, &size);
+	    if (align == 0 || (align & (align - 1)) != 0) {
+		printf("Alignment %u is not a power of 2 in tracefile %s\n",
+		       align, path);
+		exit(1);
+	    }
+	    trace->ops[op_index].type = MEMALIGN;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].align = align;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'c': /* "c index size" allocates a zeroed block */
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = CALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 's': /* "s index" frees with the size of the block */
+	    fscanf(tracefile, "%u", &index);
+	    trace->ops[op_index].type = SIZED_FREE;
+	    trace->ops[op_index].index = index;
+	    break;
+	case 'A': /* "A index count size" allocates ids index..index+count-1 */
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    if (count == 0) {
+		printf("Empty batch in tracefile %s\n", path);
+		exit(1);
+	    }
+	    trace->ops[op_index].type = BATCH_ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = size;
+	    index += count - 1;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'F': /* "F index count" frees ids index..index+count-1 */
+	    fscanf(tracefile, "%u %u", &index, &count);
+	    trace->ops[op_index].type = BATCH_FREE;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
 	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
 		   type[0], path);
 	    exit(1);
 	}
+	if (trace->ops[op_index].type == BATCH_ALLOC ||
+	    trace->ops[op_index].type == BATCH_FREE)
+	    trace->num_blocks += trace->ops[op_index].count;
+	else
+	    trace->num_blocks++;
 	op_index++;
 	
     }
@@ -556,14 +754,15 @@ static trace_t *read_trace(char *tracedir, char *filename)
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
+ * free_trace - Free the trace record and the four arrays it points
  *              to, all of which were allocated in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    free(trace->ops);         /* free the four arrays... */
     free(trace->blocks);      
     free(trace->block_sizes);
+    free(trace->batch);
     free(trace);              /* and the trace record itself... */
 }
 
@@ -572,13 +771,47 @@ void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * eval_mm_limits - Check that the mm malloc package refuses requests too
+ *    large for any heap, both in the default heap and in a heap of its own,
+ *    which keeps even the largest requests in its region
+ */
+static int eval_mm_limits(int tracenum)
+{
+    mm_heap_t *heap;
+    char *p;
+    int ok = 1;
+
+    if (mm_malloc(SIZE_MAX) != NULL || mm_calloc(1, SIZE_MAX) != NULL ||
+	mm_memalign(64, SIZE_MAX) != NULL) {
+	malloc_error(tracenum, 0, "mm_malloc did not refuse SIZE_MAX bytes");
+	return 0;
+    }
+    if ((heap = mm_heap_create()) == NULL) {
+	malloc_error(tracenum, 0, "mm_heap_create failed");
+	return 0;
+    }
+    if (mm_heap_malloc(heap, SIZE_MAX) != NULL ||
+	mm_heap_malloc(heap, SIZE_MAX - 8) != NULL) {
+	malloc_error(tracenum, 0, "mm_heap_malloc did not refuse SIZE_MAX bytes");
+	ok = 0;
+    }
+    else if ((p = mm_heap_malloc(heap, 16)) == NULL ||
+	     mm_heap_realloc(heap, p, SIZE_MAX) != NULL) {
+	malloc_error(tracenum, 0, "mm_heap_realloc did not refuse SIZE_MAX bytes");
+	ok = 0;
+    }
+    mm_heap_destroy(heap);
+    return ok;
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    unsigned i, j;
-    int index;
+    unsigned i, j, k;
+    int index, count;
     unsigned size;
     unsigned oldsize;
     char *newp;
@@ -594,19 +827,32 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
+    if (!eval_mm_limits(tracenum))
+	return 0;
 
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
 	index = trace->ops[i].index;
 	size = trace->ops[i].size;
+	count = trace->ops[i].count;
 
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_malloc */
+        case ALLOC:    /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC:   /* mm_calloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+	    if (trace->ops[i].type == MEMALIGN)
+		p = mm_memalign(trace->ops[i].align, size);
+	    else if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else
+		p = mm_malloc(size);
+	    if (p == NULL) {
+		malloc_error(tracenum, i, trace->ops[i].type == MEMALIGN ?
+			     "mm_memalign failed." : trace->ops[i].type == CALLOC ?
+			     "mm_calloc failed." : "mm_malloc failed.");
 		return 0;
 	    }
 	    
@@ -615,8 +861,23 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     * to the range list if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
+	    if (add_range(ranges, p, size, trace->ops[i].type == MEMALIGN ?
+			  trace->ops[i].align : ALIGNMENT, tracenum, i) == 0)
+		return 0;
+	    if (mm_usable_size(p) < size) {
+		malloc_error(tracenum, i, "mm_usable_size is less than the size asked for.");
 		return 0;
+	    }
+
+	    /* A block from mm_calloc must read as zero before we fill it */
+	    if (trace->ops[i].type == CALLOC) {
+		for (j = 0; j < size; j++) {
+		    if (p[j] != 0) {
+			malloc_error(tracenum, i, "mm_calloc did not zero the block.");
+			return 0;
+		    }
+		}
+	    }
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
@@ -631,10 +892,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
         case REALLOC: /* mm_realloc */
+        case GROW:    /* mm_realloc, unless the block has room already */
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if (trace->ops[i].type == GROW && size <= mm_usable_size(oldp))
+		newp = oldp;
+	    else if ((newp = mm_realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -643,7 +907,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    remove_range(ranges, oldp);
 	    
 	    /* Check new block for correctness and add it to range list */
-	    if (add_range(ranges, newp, size, tracenum, i) == 0)
+	    if (add_range(ranges, newp, size, ALIGNMENT, tracenum, i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -654,7 +918,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -675,10 +939,50 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    mm_free(p);
 	    break;
 
+        case SIZED_FREE: /* mm_free_sized */
+	    p = trace->blocks[index];
+	    remove_range(ranges, p);
+	    mm_free_sized(p, trace->block_sizes[index]);
+	    break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+
+	    /* Call the student's batch malloc, straight into the block array */
+	    if (mm_malloc_batch(size, count, (void **)&trace->blocks[index]) !=
+		(size_t)count) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+
+	    /* Check, fill and remember every block as for mm_malloc */
+	    for (k = index; k < (unsigned)(index + count); k++) {
+		p = trace->blocks[k];
+		if (add_range(ranges, p, size, ALIGNMENT, tracenum, i) == 0)
+		    return 0;
+		memset(p, k & 0xFF, size);
+		trace->block_sizes[k] = size;
+	    }
+	    break;
+
+        case BATCH_FREE: /* mm_free_batch */
+
+	    /* Remove the regions, then hand a copy of the blocks to the student */
+	    for (k = 0; k < (unsigned)count; k++) {
+		trace->batch[k] = trace->blocks[index + k];
+		remove_range(ranges, trace->blocks[index + k]);
+	    }
+	    mm_free_batch(trace->batch, count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 
+	/* Let the package check its own heap every check_every requests */
+	if (check_every > 0 && (i + 1) % check_every == 0 && mm_checkheap(0) != 0) {
+	    malloc_error(tracenum, i, "mm_checkheap found the heap inconsistent");
+	    return 0;
+	}
     }
 
     /* As far as we know, this is a valid malloc package */
@@ -690,19 +994,29 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   peak size in bytes of the heap, together with any mappings that the
+ *   package made with mem_map, while running it on the trace.  Since
+ *   mem_sbrk() lets the students decrement the brk pointer and mappings
+ *   can be released, the final footprint may be below that peak; both,
+ *   and the mean footprint over the requests, are stored in *footprint.
+ *   Every payload is written, as a program would, so that the resident
+ *   set, sampled every RSS_EVERY requests, shows which pages the package
+ *   has given back.
  *   
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   footprint_t *footprint)
 {   
-    unsigned i;
-    int index;
+    unsigned i, k;
+    int index, count;
     unsigned size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    int heap_size = -1;  /* live bytes when footprint->heap was read */
+    double heap_sum = 0;
+    double rss_sum = 0;
+    size_t rss;
+    unsigned rss_samples = 0;
     char *p;
     char *newp, *oldp;
 
@@ -723,12 +1037,21 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_alloc */
+        case ALLOC:    /* mm_alloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC:   /* mm_calloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if (trace->ops[i].type == MEMALIGN)
+		p = mm_memalign(trace->ops[i].align, size);
+	    else if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else
+		p = mm_malloc(size);
+	    if (p == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
+	    memset(p, index & 0xFF, size);
 	    
 	    /* Remember region and size */
 	    trace->blocks[index] = p;
@@ -744,13 +1067,18 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
 	case REALLOC: /* mm_realloc */
+	case GROW:    /* mm_realloc, unless the block has room already */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if (trace->ops[i].type == GROW && newsize <= mm_usable_size(oldp))
+		newp = oldp;
+	    else if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
+	    if (newsize > oldsize)
+		memset(newp + oldsize, index & 0xFF, newsize - oldsize);
 
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
@@ -765,12 +1093,16 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 		total_size : max_total_size;
 	    break;
 
-        case FREE: /* mm_free */
+        case FREE:       /* mm_free */
+        case SIZED_FREE: /* mm_free_sized */
 	    index = trace->ops[i].index;
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    if (trace->ops[i].type == SIZED_FREE)
+		mm_free_sized(p, size);
+	    else
+		mm_free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -778,13 +1110,63 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case BATCH_ALLOC: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    count = trace->ops[i].count;
+
+	    if (mm_malloc_batch(size, count, (void **)&trace->blocks[index]) !=
+		(size_t)count)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (k = index; k < (unsigned)(index + count); k++) {
+		trace->block_sizes[k] = size;
+		memset(trace->blocks[k], k & 0xFF, size);
+	    }
+	    
+	    /* Keep track of current total size
+	     * of all allocated blocks */
+	    total_size += size * count;
+	    
+	    /* Update statistics */
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case BATCH_FREE: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    count = trace->ops[i].count;
+
+	    for (k = 0; k < (unsigned)count; k++) {
+		trace->batch[k] = trace->blocks[index + k];
+		total_size -= trace->block_sizes[index + k];
+	    }
+	    mm_free_batch(trace->batch, count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+	heap_sum += mem_heapsize() + mem_mapped_bytes();
+	if (total_size > heap_size) {
+	    heap_size = total_size;
+	    mm_get_stats(&footprint->heap);
+	}
+	if (i % RSS_EVERY == RSS_EVERY - 1 || i == trace->num_ops - 1) {
+	    rss = mem_resident_bytes();
+	    rss_sum += rss;
+	    rss_samples++;
+	    if (rss > footprint->rss_peak)
+		footprint->rss_peak = rss;
+	}
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    footprint->rss_mean = rss_samples > 0 ? rss_sum / rss_samples : 0;
+    footprint->peak = mem_peak_footprint();
+    footprint->mean = trace->num_ops > 0 ? heap_sum / trace->num_ops : 0;
+    footprint->final = mem_heapsize() + mem_mapped_bytes();
+    footprint->grows = mem_grow_count();
+    return ((double)max_total_size / (double)mem_peak_footprint());
 }
 
 
@@ -794,7 +1176,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    unsigned i, index, size, newsize;
+    unsigned i, k, index, size, newsize, count;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -815,6 +1197,22 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -824,17 +1222,93 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = newp;
             break;
 
+	case GROW: /* mm_realloc, unless the block has room already */
+	    index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+	    oldp = trace->blocks[index];
+            if (newsize <= mm_usable_size(oldp))
+                break;
+            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+		app_error("mm_realloc error in eval_mm_speed");
+            trace->blocks[index] = newp;
+            break;
+
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
             mm_free(block);
             break;
 
+        case SIZED_FREE: /* mm_free_sized */
+            index = trace->ops[i].index;
+            block = trace->blocks[index];
+            mm_free_sized(block, trace->block_sizes[index]);
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            count = trace->ops[i].count;
+            if (mm_malloc_batch(size, count, (void **)&trace->blocks[index]) != count)
+		app_error("mm_malloc_batch error in eval_mm_speed");
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            count = trace->ops[i].count;
+            for (k = 0; k < count; k++)
+                trace->batch[k] = trace->blocks[index + k];
+            mm_free_batch(trace->batch, count);
+            break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 }
 
+/*
+ * eval_mm_tlb - runs the trace once as eval_mm_speed does, and counts the
+ *    dTLB load misses in user mode and the page faults of the run.  The
+ *    misses are -1 if the system does not let us count them.
+ */
+static void eval_mm_tlb(speed_t *params, tlb_t *tlb)
+{
+    struct perf_event_attr attr;
+    struct rusage before, after;
+    long long count;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+	(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+    getrusage(RUSAGE_SELF, &before);
+    if (fd >= 0) {
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    eval_mm_speed(params);
+    if (fd >= 0)
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    getrusage(RUSAGE_SELF, &after);
+
+    tlb->misses = -1;
+    if (fd >= 0) {
+	if (read(fd, &count, sizeof(count)) == sizeof(count))
+	    tlb->misses = (long)count;
+	close(fd);
+    }
+    tlb->faults = (after.ru_minflt - before.ru_minflt) +
+	(after.ru_majflt - before.ru_majflt);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -844,6 +1318,7 @@ static void eval_mm_speed(void *ptr)
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
     unsigned i, newsize;
+    int k;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -857,9 +1332,28 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    trace->blocks[trace->ops[i].index] = p;
 	    break;
 
+        case MEMALIGN: /* memalign */
+	    if ((p = memalign(trace->ops[i].align, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
+	case GROW:    /* realloc, unless the block has room already */
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[trace->ops[i].index];
+	    if (trace->ops[i].type == GROW && newsize <= malloc_usable_size(oldp))
+		break;
 	    if ((newp = realloc(oldp, newsize)) == NULL) {
 		malloc_error(tracenum, i, "libc realloc failed");
 		unix_error("System message");
@@ -867,10 +1361,26 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    trace->blocks[trace->ops[i].index] = newp;
 	    break;
 	    
-        case FREE: /* free */
+        case FREE:       /* free */
+        case SIZED_FREE: /* libc has no sized free */
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+        case BATCH_ALLOC: /* one malloc per block of the batch */
+	    for (k = 0; k < trace->ops[i].count; k++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + k] = p;
+	    }
+	    break;
+
+        case BATCH_FREE: /* one free per block of the batch */
+	    for (k = 0; k < trace->ops[i].count; k++)
+		free(trace->blocks[trace->ops[i].index + k]);
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -887,7 +1397,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 static void eval_libc_speed(void *ptr)
 {
     unsigned i;
-    int index, size, newsize;
+    int index, size, newsize, k;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -901,21 +1411,57 @@ static void eval_libc_speed(void *ptr)
 	    trace->blocks[index] = p;
 	    break;
 
+        case MEMALIGN: /* memalign */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = memalign(trace->ops[i].align, size)) == NULL)
+		unix_error("memalign failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = calloc(1, size)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
+	case GROW:    /* realloc, unless the block has room already */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
+	    if (trace->ops[i].type == GROW && (size_t)newsize <= malloc_usable_size(oldp))
+		break;
 	    if ((newp = realloc(oldp, newsize)) == NULL)
 		unix_error("realloc failed in eval_libc_speed\n");
 	    
 	    trace->blocks[index] = newp;
 	    break;
 	    
-        case FREE: /* free */
+        case FREE:       /* free */
+        case SIZED_FREE: /* libc has no sized free */
 	    index = trace->ops[i].index;
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+        case BATCH_ALLOC: /* one malloc per block of the batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    for (k = 0; k < trace->ops[i].count; k++) {
+		if ((p = malloc(size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+		trace->blocks[index + k] = p;
+	    }
+	    break;
+
+        case BATCH_FREE: /* one free per block of the batch */
+	    index = trace->ops[i].index;
+	    for (k = 0; k < trace->ops[i].count; k++)
+		free(trace->blocks[index + k]);
+	    break;
 	}
     }
 }
@@ -984,6 +1530,194 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printcachestats - prints the cache counters of the mm malloc package,
+ *    as they stood at the end of the utilization run of each trace
+ */
+static void printcachestats(int n, stats_t *stats)
+{
+    int i;
+    unsigned long hits = 0, misses = 0, frees = 0, flushes = 0;
+
+    printf("%5s%10s%10s%7s%10s%9s\n",
+	   "trace", "hits", "misses", "hit%", "frees", "flushes");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13lu%10lu%6.0f%%%10lu%9lu\n",
+		   i,
+		   stats[i].cache.hits,
+		   stats[i].cache.misses,
+		   stats[i].cache.hits + stats[i].cache.misses > 0 ?
+		   100.0 * stats[i].cache.hits /
+		   (stats[i].cache.hits + stats[i].cache.misses) : 0.0,
+		   stats[i].cache.frees,
+		   stats[i].cache.flushes);
+	    hits += stats[i].cache.hits;
+	    misses += stats[i].cache.misses;
+	    frees += stats[i].cache.frees;
+	    flushes += stats[i].cache.flushes;
+	}
+	else {
+	    printf("%2d%13s%10s%7s%10s%9s\n", i, "-", "-", "-", "-", "-");
+	}
+    }
+    printf("%5s%10lu%10lu%6.0f%%%10lu%9lu\n",
+	   "Total",
+	   hits,
+	   misses,
+	   hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+	   frees,
+	   flushes);
+}
+
+/*
+ * printfootprint - prints the heap footprint of the mm malloc package
+ *    during the utilization run of each trace, in KB, its resident set next
+ *    to the utilization, and how often the heap grew
+ */
+static void printfootprint(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%10s%10s%10s%7s%10s%10s%8s\n", "trace", "peak", "mean", "final",
+	   "util", "rssPeak", "rssMean", "grows");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13.1f%10.1f%10.1f%6.0f%%%10.1f%10.1f%8lu\n",
+		   i,
+		   stats[i].footprint.peak / 1024.0,
+		   stats[i].footprint.mean / 1024.0,
+		   stats[i].footprint.final / 1024.0,
+		   stats[i].util*100.0,
+		   stats[i].footprint.rss_peak / 1024.0,
+		   stats[i].footprint.rss_mean / 1024.0,
+		   stats[i].footprint.grows);
+	}
+	else {
+	    printf("%2d%13s%10s%10s%7s%10s%10s%8s\n", i, "-", "-", "-", "-", "-",
+		   "-", "-");
+	}
+    }
+}
+
+/*
+ * printheapstats - prints the mm_get_stats counters of the mm malloc
+ *    package when the live bytes of each trace peaked: the free blocks, the
+ *    share of free bytes outside the largest free block, and the number of
+ *    splits, coalesces, heap growths and heap shrinks up to that point
+ */
+static void printheapstats(int n, stats_t *stats)
+{
+    int i;
+    mm_stats_t *h;
+
+    printf("%5s%8s%10s%10s%6s%9s%10s%7s%8s\n", "trace", "free", "freeKB",
+	   "largestKB", "frag", "splits", "coalesces", "grows", "shrinks");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    h = &stats[i].footprint.heap;
+	    printf("%2d%11lu%10.1f%10.1f%5.0f%%%9lu%10lu%7lu%8lu\n",
+		   i,
+		   (unsigned long)h->free_blocks,
+		   h->free_bytes / 1024.0,
+		   h->largest_free / 1024.0,
+		   h->free_bytes > 0 ?
+		   100.0 * (h->free_bytes - h->largest_free) / h->free_bytes : 0.0,
+		   h->splits,
+		   h->coalesces,
+		   h->grows,
+		   h->shrinks);
+	}
+	else {
+	    printf("%2d%11s%10s%10s%6s%9s%10s%7s%8s\n", i, "-", "-", "-", "-",
+		   "-", "-", "-", "-");
+	}
+    }
+}
+
+/*
+ * printtlb - prints the dTLB load misses and page faults of one run of
+ *    each trace by the mm malloc package, first with huge pages turned
+ *    off in memlib and then with them turned on
+ */
+static void printtlb(int n, stats_t *stats)
+{
+    int i, k;
+
+    printf("%5s%12s%12s%10s%10s\n", "trace", "misses4K", "misses2M",
+	   "faults4K", "faults2M");
+    for (i=0; i < n; i++) {
+	printf("%2d%3s", i, "");
+	for (k = 0; k < 2; k++) {
+	    if (stats[i].valid && stats[i].tlb[k].misses >= 0)
+		printf("%12ld", stats[i].tlb[k].misses);
+	    else
+		printf("%12s", "-");
+	}
+	for (k = 0; k < 2; k++) {
+	    if (stats[i].valid)
+		printf("%10ld", stats[i].tlb[k].faults);
+	    else
+		printf("%10s", "-");
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * printinstrument - prints the hot-path counters of the mm malloc package
+ *    over the utilization run of each trace: how many blocks each fit
+ *    search visited, which neighbours each coalesce merged with, how often
+ *    place split a block, and how each realloc of a heap block was served
+ */
+static void printinstrument(int n, stats_t *stats)
+{
+    static const char *bins[MM_PROBE_BINS] = {
+	"0", "1", "2", "3-4", "5-8", "9-16", "17-32", "33+"
+    };
+    mm_instrument_t *s;
+    int i, k;
+
+    printf("Blocks visited per fit search:\n%5s", "trace");
+    for (k = 0; k < MM_PROBE_BINS; k++)
+	printf("%8s", bins[k]);
+    printf("\n");
+    for (i=0; i < n; i++) {
+	printf("%2d%3s", i, "");
+	for (k = 0; k < MM_PROBE_BINS; k++) {
+	    if (stats[i].valid)
+		printf("%8lu", stats[i].inst.probes[k]);
+	    else
+		printf("%8s", "-");
+	}
+	printf("\n");
+    }
+
+    printf("Coalesces, placements and reallocations:\n");
+    printf("%5s%8s%8s%8s%8s%8s%8s%9s%8s%8s\n", "trace", "none", "next",
+	   "prev", "both", "split", "whole", "inplace", "slid", "copied");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    s = &stats[i].inst;
+	    printf("%2d%11lu%8lu%8lu%8lu%8lu%8lu%9lu%8lu%8lu\n",
+		   i,
+		   s->coalesce[0],
+		   s->coalesce[1],
+		   s->coalesce[2],
+		   s->coalesce[3],
+		   s->place_split,
+		   s->place_whole,
+		   s->realloc_inplace,
+		   s->realloc_slid,
+		   s->realloc_copied);
+	}
+	else {
+	    printf("%2d%11s%8s%8s%8s%8s%8s%9s%8s%8s\n", i, "-", "-", "-", "-",
+		   "-", "-", "-", "-", "-");
+	}
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1016,14 +1750,26 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValcmSuzCGHT] [-f <file>] [-t <dir>] [-k <n>] [-M <mb>] [-L <mb>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-C         Allocate with mm_calloc.\n");
+    fprintf(stderr, "\t-c         Print the cache counters of mm malloc.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+    fprintf(stderr, "\t-G         Grow the mm heap adaptively.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Don't use huge pages for the mm heap.\n");
+    fprintf(stderr, "\t-k <n>     Check the mm heap every <n> requests.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L <mb>    Commit at most <mb> MB of simulated memory.\n");
+    fprintf(stderr, "\t-M <mb>    Reserve <mb> MB for every heap (default 20).\n");
+    fprintf(stderr, "\t-m         Print the heap footprint of mm malloc.\n");
+    fprintf(stderr, "\t-S         Print the heap counters of mm malloc.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T         Print TLB misses and page faults with and without huge pages.\n");
+    fprintf(stderr, "\t-u         Reallocate only past mm_usable_size.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-z         Free with mm_free_sized.\n");
 }
@@ -2,7 +2,42 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The simulated memory is made of regions, each with its own
+ *            storage and brk pointer.  The default region is created by
+ *            mem_init and is the one the mem_xxx functions below work on.
+ *            The storage of a region is an anonymous mapping, so memory
+ *            that sbrk hands out for the first time since the region was
+ *            created or last reset reads as zero, as fresh pages from the
+ *            system would.  Each region reserves its whole range of
+ *            addresses up front with no access, and sbrk commits pages
+ *            of it with mprotect as the brk passes them, a COMMIT_CHUNK
+ *            at a time.  When the brk moves back down more than a
+ *            commit step below the committed pages, those above it are
+ *            given back and protected again, so a region costs little
+ *            more than what its heap uses.  The
+ *            size of the range, MAX_HEAP by default, and a limit on the
+ *            bytes committed by all regions together are set with
+ *            mem_set_limits.
+ *
+ *            Every region starts on a HUGE_PAGE boundary.  Unless
+ *            mem_set_hugepages turns them off, regions are marked for
+ *            transparent huge pages with madvise, and sbrk commits whole
+ *            huge pages at a time, so that the kernel can back a large
+ *            heap with few TLB entries.
+ *
+ *            Large objects may instead get mappings of their own from
+ *            mem_map, outside of every region.  Their caller passes the
+ *            length back to mem_unmap and mem_remap, so memlib need not
+ *            look them up.  Only when mem_track_mappings turns it on does
+ *            memlib keep a table of them, so that the driver can check
+ *            payloads against them, measure them, and unmap the ones left
+ *            over when the default heap is reset.  The bytes of all heaps
+ *            and mappings together are counted as the footprint of the
+ *            allocator.
  */
+#define _GNU_SOURCE       /* for mremap */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,28 +45,197 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
+#define COMMIT_CHUNK (64 * 1024)  /* least amount committed at a time */
+#define HUGE_PAGE (2 * 1024 * 1024) /* size and alignment of a huge page */
+#define MAP_BUCKETS 256             /* buckets of the table of mappings */
+
+/* A region of the simulated memory system */
+struct mem_region {
+    char *start_brk;  /* points to first byte of heap */
+    char *brk;        /* points to last byte of heap */
+    char *peak_brk;   /* highest brk since the heap was last reset */
+    char *fresh_brk;  /* storage from here up has never been handed out */
+    char *commit_brk; /* storage from here up is reserved but not committed */
+    char *max_addr;   /* largest legal heap address */ 
+};
+
+/* A mapping made by mem_map */
+typedef struct mem_mapping {
+    char *start;               /* first byte of the mapping */
+    size_t size;               /* length of the mapping in bytes */
+    struct mem_mapping *next;  /* next mapping in the same bucket */
+} mem_mapping_t;
+
+/* The bucket of the table of mappings for a mapping that starts at p */
+#define MAP_BUCKET(p) (((uintptr_t)(p) / 4096) % MAP_BUCKETS)
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_region_t mem_default;  /* the region behind mem_sbrk & co. */
+static mem_mapping_t *mappings[MAP_BUCKETS]; /* tracked mappings by start */
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+static int tracking;              /* keep the table of mappings? */
+static size_t mapped;             /* bytes in all mappings */
+static size_t footprint;          /* bytes in all heaps and mappings */
+static size_t peak_footprint;     /* largest footprint since the last reset */
+static unsigned long grow_count;  /* sbrk calls that grew a heap since then */
+static size_t reserve = MAX_HEAP; /* bytes of address space of each region */
+static size_t commit_limit;       /* most bytes committed in all regions (0: none) */
+static size_t committed;          /* bytes committed in all regions */
+static int hugepages = 1;         /* use transparent huge pages? */
+
+static void footprint_add(intptr_t incr);
+static size_t resident_bytes(char *p, size_t size);
+static int region_commit(mem_region_t *r, char *brk);
+static void region_decommit(mem_region_t *r, char *brk);
+static mem_mapping_t **mapping_find(char *p);
+
+/*
+ * region_init - reserve the storage of a region and make its heap empty
+ */
+static int region_init(mem_region_t *r)
+{
+    char *p;
+    size_t head;
+
+    /* reserve the storage we will use to model the available VM */
+    p = mmap(NULL, reserve + HUGE_PAGE, PROT_NONE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+	return -1;
+
+    /* keep just the part that starts on a huge page boundary */
+    head = (HUGE_PAGE - (uintptr_t)p % HUGE_PAGE) % HUGE_PAGE;
+    if (head > 0)
+	munmap(p, head);
+    munmap(p + head + reserve, HUGE_PAGE - head);
+    r->start_brk = p + head;
+#ifdef MADV_HUGEPAGE
+    if (hugepages)
+	madvise(r->start_brk, reserve, MADV_HUGEPAGE);
+#endif
+
+    r->max_addr = r->start_brk + reserve;   /* max legal heap address */
+    r->brk = r->start_brk;                  /* heap is empty initially */
+    r->peak_brk = r->start_brk;
+    r->fresh_brk = r->start_brk;            /* all of it reads as zero */
+    r->commit_brk = r->start_brk;           /* none of it is committed */
+    return 0;
+}
+
+/*
+ * region_commit - commit the storage of region r up to at least brk,
+ *    in steps of COMMIT_CHUNK bytes, or of HUGE_PAGE bytes with huge pages,
+ *    unless that would pass the end of the region or the commit limit.  Returns 0 on success and -1 if
+ *    the pages cannot be committed.
+ */
+static int region_commit(mem_region_t *r, char *brk)
+{
+    size_t pagesize = mem_pagesize();
+    size_t need = pagesize * (((size_t)(brk - r->commit_brk) + pagesize - 1) / pagesize);
+    size_t step = hugepages ? HUGE_PAGE : COMMIT_CHUNK;
+    size_t used = (size_t)(r->commit_brk - r->start_brk);
+    size_t incr, total;
+
+    /* commit up to a multiple of the step from the start of the region */
+    incr = step * ((used + need + step - 1) / step) - used;
+    if (incr > (size_t)(r->max_addr - r->commit_brk))
+	incr = (size_t)(r->max_addr - r->commit_brk);
+    total = __atomic_add_fetch(&committed, incr, __ATOMIC_RELAXED);
+    if (commit_limit != 0 && total > commit_limit && incr > need) {
+	/* Fall back on just the pages that are needed. */
+	__atomic_sub_fetch(&committed, incr - need, __ATOMIC_RELAXED);
+	total -= incr - need;
+	incr = need;
+    }
+    if ((commit_limit != 0 && total > commit_limit) ||
+	mprotect(r->commit_brk, incr, PROT_READ | PROT_WRITE) < 0) {
+	__atomic_sub_fetch(&committed, incr, __ATOMIC_RELAXED);
+	return -1;
+    }
+    r->commit_brk += incr;
+    return 0;
+}
+
+/*
+ * region_decommit - once region r holds more than a commit step, as
+ *    region_commit takes them, committed above brk, give the committed
+ *    pages from the first step boundary at or above brk back to the system
+ *    and protect them again, so that committed memory follows a heap that
+ *    shrinks, without a heap that shrinks and grows by a little at a time
+ *    committing and decommitting the same pages over and over.  They read
+ *    as zero when they are next committed.
+ */
+static void region_decommit(mem_region_t *r, char *brk)
+{
+    size_t step = hugepages ? HUGE_PAGE : COMMIT_CHUNK;
+    char *lo = r->start_brk +
+	step * (((size_t)(brk - r->start_brk) + step - 1) / step);
+
+    if ((size_t)(r->commit_brk - brk) <= step || lo >= r->commit_brk)
+	return;
+    madvise(lo, r->commit_brk - lo, MADV_DONTNEED);
+    mprotect(lo, r->commit_brk - lo, PROT_NONE);
+    __atomic_sub_fetch(&committed, r->commit_brk - lo, __ATOMIC_RELAXED);
+    r->commit_brk = lo;
+    if (r->fresh_brk > lo)
+	r->fresh_brk = lo;
+}
+
+/*
+ * mem_set_limits - set the bytes of address space that each region
+ *    reserves, rounded up to a page (0 keeps MAX_HEAP), and the most bytes
+ *    that all regions together may commit (0 for no limit).  The size
+ *    applies to regions created afterwards, so it should be set before
+ *    mem_init; the limit applies from now on.
+ */
+void mem_set_limits(size_t region_size, size_t limit)
+{
+    size_t pagesize = mem_pagesize();
+
+    if (region_size == 0)
+	region_size = MAX_HEAP;
+    reserve = pagesize * ((region_size + pagesize - 1) / pagesize);
+    commit_limit = limit;
+}
+
+/*
+ * mem_set_hugepages - turn transparent huge pages on (the default) or off
+ *    for the default region and for regions created afterwards.  Pages
+ *    that are already in use keep their size until they are given back.
+ */
+void mem_set_hugepages(int on)
+{
+    hugepages = on;
+#ifdef MADV_HUGEPAGE
+    if (mem_default.start_brk != NULL)
+	madvise(mem_default.start_brk, mem_default.max_addr - mem_default.start_brk,
+		on ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+}
+
+/*
+ * mem_committed_bytes - returns the number of bytes committed in all
+ *    regions
+ */
+size_t mem_committed_bytes(void)
+{
+    return __atomic_load_n(&committed, __ATOMIC_RELAXED);
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
+    if (region_init(&mem_default) < 0) {
 	fprintf(stderr, "mem_init_vm: malloc error\n");
 	exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
 }
 
 /* 
@@ -39,33 +243,42 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    __atomic_sub_fetch(&committed, mem_default.commit_brk - mem_default.start_brk,
+		       __ATOMIC_RELAXED);
+    munmap(mem_default.start_brk, mem_default.max_addr - mem_default.start_brk);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    and unmap the tracked mappings that are still live, which belonged
+ *    to the heap that is gone.  Untracked ones are forgotten.
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_mapping_t *m;
+    int i;
+
+    pthread_mutex_lock(&mappings_lock);
+    for (i = 0; i < MAP_BUCKETS; i++) {
+	while ((m = mappings[i]) != NULL) {
+	    mappings[i] = m->next;
+	    munmap(m->start, m->size);
+	    free(m);
+	}
+    }
+    pthread_mutex_unlock(&mappings_lock);
+    footprint_add(-(intptr_t)__atomic_exchange_n(&mapped, 0, __ATOMIC_RELAXED));
+    mem_region_reset_brk(&mem_default);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.  A
+ *    negative incr shrinks the heap, and returns the old brk.
  */
 void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
-
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+    return mem_region_sbrk(&mem_default, incr);
 }
 
 /*
@@ -73,7 +286,7 @@ void *mem_sbrk(intptr_t incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_region_lo(&mem_default);
 }
 
 /* 
@@ -81,7 +294,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_region_hi(&mem_default);
 }
 
 /*
@@ -89,7 +302,16 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_region_heapsize(&mem_default);
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size, in bytes, since
+ *    the heap was last reset
+ */
+size_t mem_peak_heapsize()
+{
+    return mem_region_peak_heapsize(&mem_default);
 }
 
 /*
@@ -99,3 +321,371 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_default_region - return the region behind mem_sbrk and friends
+ */
+mem_region_t *mem_default_region(void)
+{
+    return &mem_default;
+}
+
+/*
+ * mem_region_create - create a new region with its own storage and an
+ *    empty heap, or return NULL if the storage cannot be allocated.
+ *    This is the only region routine that may be called concurrently
+ *    from several threads; the others require exclusive use of r.
+ */
+mem_region_t *mem_region_create(void)
+{
+    mem_region_t *r;
+
+    if ((r = (mem_region_t *)malloc(sizeof(mem_region_t))) == NULL)
+	return NULL;
+    if (region_init(r) < 0) {
+	free(r);
+	return NULL;
+    }
+    return r;
+}
+
+/*
+ * mem_region_destroy - free a region created by mem_region_create
+ */
+void mem_region_destroy(mem_region_t *r)
+{
+    footprint_add(-(r->brk - r->start_brk));
+    __atomic_sub_fetch(&committed, r->commit_brk - r->start_brk, __ATOMIC_RELAXED);
+    munmap(r->start_brk, r->max_addr - r->start_brk);
+    free(r);
+}
+
+/*
+ * mem_region_reset_brk - reset the brk pointer of a region, and give the
+ *    pages it has handed out back to the system, so that they read as
+ *    zero again and fault in afresh like new pages when they are used.
+ *    The pages stay committed.
+ */
+void mem_region_reset_brk(mem_region_t *r)
+{
+    footprint_add(-(r->brk - r->start_brk));
+    if (r->fresh_brk > r->start_brk)
+	madvise(r->start_brk, r->fresh_brk - r->start_brk, MADV_DONTNEED);
+    r->brk = r->start_brk;
+    r->peak_brk = r->start_brk;
+    r->fresh_brk = r->start_brk;
+    __atomic_store_n(&peak_footprint, __atomic_load_n(&footprint, __ATOMIC_RELAXED),
+		     __ATOMIC_RELAXED);
+    __atomic_store_n(&grow_count, 0, __ATOMIC_RELAXED);
+}
+
+/* 
+ * mem_region_sbrk - mem_sbrk for the heap of region r
+ */
+void *mem_region_sbrk(mem_region_t *r, intptr_t incr) 
+{
+    char *old_brk = r->brk;
+
+    if (incr < 0 && -incr > r->brk - r->start_brk) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Shrank below the start of the heap...\n");
+	return (void *)-1;
+    }
+    if (incr > r->max_addr - r->brk ||
+	(r->brk + incr > r->commit_brk && region_commit(r, r->brk + incr) < 0)) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    r->brk += incr;
+    if (r->brk > r->peak_brk)
+	r->peak_brk = r->brk;
+    if (r->brk > r->fresh_brk)
+	r->fresh_brk = r->brk;
+    if (incr > 0)
+	__atomic_add_fetch(&grow_count, 1, __ATOMIC_RELAXED);
+    else if (incr < 0)
+	region_decommit(r, r->brk);
+    footprint_add(incr);
+    return (void *)old_brk;
+}
+
+/*
+ * mem_region_lo - return address of the first heap byte of region r
+ */
+void *mem_region_lo(mem_region_t *r)
+{
+    return (void *)r->start_brk;
+}
+
+/* 
+ * mem_region_hi - return address of last heap byte of region r
+ */
+void *mem_region_hi(mem_region_t *r)
+{
+    return (void *)(r->brk - 1);
+}
+
+/*
+ * mem_region_heapsize - returns the heap size of region r in bytes
+ */
+size_t mem_region_heapsize(mem_region_t *r)
+{
+    return (size_t)(r->brk - r->start_brk);
+}
+
+/*
+ * mem_region_peak_heapsize - returns the largest heap size of region r,
+ *    in bytes, since its heap was last reset
+ */
+size_t mem_region_peak_heapsize(mem_region_t *r)
+{
+    return (size_t)(r->peak_brk - r->start_brk);
+}
+
+/*
+ * mem_region_fresh_lo - return the lowest address of region r from which
+ *    its storage has never been handed out by sbrk since the region was
+ *    created or last reset.  Memory from there up reads as zero.  A
+ *    shrunk heap lowers it only as far as the pages it decommits, since
+ *    the rest of the memory given back keeps whatever was written to it.
+ */
+void *mem_region_fresh_lo(mem_region_t *r)
+{
+    return (void *)r->fresh_brk;
+}
+
+/*
+ * mem_region_contains - return true if p lies in the storage of region r,
+ *    whether or not it is below the brk.  Safe to call while another
+ *    thread moves the brk of r.
+ */
+int mem_region_contains(mem_region_t *r, void *p)
+{
+    return (char *)p >= r->start_brk && (char *)p < r->max_addr;
+}
+
+/*
+ * mem_release - give the size bytes at p, whole pages of a heap, back to
+ *    the system.  They stay in the heap, read as zero, and fault in again
+ *    when they are next written.  Safe to call from several threads.
+ */
+void mem_release(void *p, size_t size)
+{
+    madvise(p, size, MADV_DONTNEED);
+}
+
+/*
+ * mem_resident_bytes - returns the number of bytes of the default heap
+ *    and of the tracked mappings that are resident in memory
+ */
+size_t mem_resident_bytes(void)
+{
+    size_t pagesize = mem_pagesize();
+    size_t bytes;
+    mem_mapping_t *m;
+    int i;
+
+    bytes = resident_bytes(mem_default.start_brk,
+			   (mem_default.brk - mem_default.start_brk + pagesize - 1) /
+			   pagesize * pagesize);
+    pthread_mutex_lock(&mappings_lock);
+    for (i = 0; i < MAP_BUCKETS; i++)
+	for (m = mappings[i]; m != NULL; m = m->next)
+	    bytes += resident_bytes(m->start, m->size);
+    pthread_mutex_unlock(&mappings_lock);
+    return bytes;
+}
+
+/*
+ * mem_track_mappings - turn the table of mappings on or off.  With it on,
+ *    mem_map, mem_unmap and mem_remap keep it up to date under a lock,
+ *    which the allocator does not need but the driver does, for
+ *    mem_mapped, mem_resident_bytes and mem_reset_brk.  Set it before any
+ *    mapping is made.
+ */
+void mem_track_mappings(int on)
+{
+    tracking = on;
+}
+
+/*
+ * mem_map - create a private anonymous mapping of size bytes, which must
+ *    be a multiple of the page size, and return its start address, or
+ *    NULL if the mapping cannot be made.  Safe to call from several
+ *    threads, as are mem_unmap, mem_remap and mem_mapped.
+ */
+void *mem_map(size_t size)
+{
+    mem_mapping_t *m = NULL;
+    char *p;
+
+    if (tracking && (m = (mem_mapping_t *)malloc(sizeof(mem_mapping_t))) == NULL)
+	return NULL;
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+	free(m);
+	return NULL;
+    }
+    if (m != NULL) {
+	m->start = p;
+	m->size = size;
+	pthread_mutex_lock(&mappings_lock);
+	m->next = mappings[MAP_BUCKET(p)];
+	mappings[MAP_BUCKET(p)] = m;
+	pthread_mutex_unlock(&mappings_lock);
+    }
+    __atomic_add_fetch(&mapped, size, __ATOMIC_RELAXED);
+    footprint_add(size);
+    return p;
+}
+
+/*
+ * mem_unmap - remove the mapping of size bytes that starts at p, made by
+ *    mem_map
+ */
+void mem_unmap(void *p, size_t size)
+{
+    mem_mapping_t **mp, *m;
+
+    if (tracking) {
+	pthread_mutex_lock(&mappings_lock);
+	if ((m = *(mp = mapping_find(p))) != NULL)
+	    *mp = m->next;
+	pthread_mutex_unlock(&mappings_lock);
+	free(m);
+    }
+    munmap(p, size);
+    __atomic_sub_fetch(&mapped, size, __ATOMIC_RELAXED);
+    footprint_add(-(intptr_t)size);
+}
+
+/*
+ * mem_remap - resize the mapping of oldsize bytes that starts at p to size
+ *    bytes, a multiple of the page size, moving it if it cannot grow in
+ *    place.  The contents are kept up to the smaller of the two sizes
+ *    without being copied.  Returns the new start address, or NULL, leaving
+ *    the mapping unchanged, if it cannot be resized.
+ */
+void *mem_remap(void *p, size_t oldsize, size_t size)
+{
+    mem_mapping_t **mp, *m = NULL;
+    char *newp;
+
+    if ((newp = mremap(p, oldsize, size, MREMAP_MAYMOVE)) == MAP_FAILED)
+	return NULL;
+    if (tracking) {
+	pthread_mutex_lock(&mappings_lock);
+	if ((m = *(mp = mapping_find(p))) != NULL) {
+	    *mp = m->next;
+	    m->start = newp;
+	    m->size = size;
+	    m->next = mappings[MAP_BUCKET(newp)];
+	    mappings[MAP_BUCKET(newp)] = m;
+	}
+	pthread_mutex_unlock(&mappings_lock);
+    }
+    __atomic_add_fetch(&mapped, size - oldsize, __ATOMIC_RELAXED);
+    footprint_add((intptr_t)size - (intptr_t)oldsize);
+    return newp;
+}
+
+/*
+ * mem_mapped - return true if the size bytes at p lie within a single
+ *    tracked mapping
+ */
+int mem_mapped(void *p, size_t size)
+{
+    mem_mapping_t *m;
+    int found = 0;
+    int i;
+
+    pthread_mutex_lock(&mappings_lock);
+    for (i = 0; i < MAP_BUCKETS && !found; i++) {
+	for (m = mappings[i]; m != NULL; m = m->next) {
+	    if ((char *)p >= m->start && (char *)p + size <= m->start + m->size) {
+		found = 1;
+		break;
+	    }
+	}
+    }
+    pthread_mutex_unlock(&mappings_lock);
+    return found;
+}
+
+/*
+ * mem_mapped_bytes - returns the number of bytes in all mappings
+ */
+size_t mem_mapped_bytes(void)
+{
+    return __atomic_load_n(&mapped, __ATOMIC_RELAXED);
+}
+
+/*
+ * mem_peak_footprint - returns the largest number of bytes that all heaps
+ *    and mappings held together since the default heap was last reset
+ */
+size_t mem_peak_footprint(void)
+{
+    return __atomic_load_n(&peak_footprint, __ATOMIC_RELAXED);
+}
+
+/*
+ * mem_grow_count - returns the number of sbrk calls that grew a heap
+ *    since the default heap was last reset
+ */
+unsigned long mem_grow_count(void)
+{
+    return __atomic_load_n(&grow_count, __ATOMIC_RELAXED);
+}
+
+/*
+ * mapping_find - return the link that points to the tracked mapping that
+ *    starts at p, which points to NULL if there is none.  The caller holds
+ *    mappings_lock.
+ */
+static mem_mapping_t **mapping_find(char *p)
+{
+    mem_mapping_t **mp;
+
+    for (mp = &mappings[MAP_BUCKET(p)]; *mp != NULL && (*mp)->start != p; mp = &(*mp)->next)
+	;
+    return mp;
+}
+
+/*
+ * resident_bytes - returns the number of bytes of the size bytes at p, a
+ *    page-aligned range, that are resident in memory
+ */
+static size_t resident_bytes(char *p, size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    unsigned char vec[1024];
+    size_t bytes = 0;
+    size_t len, i;
+
+    for (; size > 0; p += len, size -= len) {
+	len = size < sizeof(vec) * pagesize ? size : sizeof(vec) * pagesize;
+	if (mincore(p, len, vec) < 0)
+	    continue;
+	for (i = 0; i < (len + pagesize - 1) / pagesize; i++)
+	    if (vec[i] & 1)
+		bytes += pagesize;
+    }
+    return bytes;
+}
+
+/*
+ * footprint_add - add incr bytes, which may be negative, to the footprint
+ *    and raise its peak if needed
+ */
+static void footprint_add(intptr_t incr)
+{
+    size_t now = __atomic_add_fetch(&footprint, incr, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&peak_footprint, __ATOMIC_RELAXED);
+
+    while (now > peak &&
+	   !__atomic_compare_exchange_n(&peak_footprint, &peak, now, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
+}
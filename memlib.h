@@ -1,3 +1,7 @@
+typedef struct mem_region mem_region_t;
+
+void mem_set_limits(size_t region_size, size_t limit);
+void mem_set_hugepages(int on);
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(intptr_t incr);
@@ -5,4 +9,29 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_committed_bytes(void);
+
+mem_region_t *mem_default_region(void);
+mem_region_t *mem_region_create(void);
+void mem_region_destroy(mem_region_t *r);
+void mem_region_reset_brk(mem_region_t *r);
+void *mem_region_sbrk(mem_region_t *r, intptr_t incr);
+void *mem_region_lo(mem_region_t *r);
+void *mem_region_hi(mem_region_t *r);
+size_t mem_region_heapsize(mem_region_t *r);
+size_t mem_region_peak_heapsize(mem_region_t *r);
+void *mem_region_fresh_lo(mem_region_t *r);
+int mem_region_contains(mem_region_t *r, void *p);
+
+void mem_track_mappings(int on);
+void *mem_map(size_t size);
+void mem_unmap(void *p, size_t size);
+void *mem_remap(void *p, size_t oldsize, size_t size);
+int mem_mapped(void *p, size_t size);
+void mem_release(void *p, size_t size);
+size_t mem_resident_bytes(void);
+size_t mem_mapped_bytes(void);
+size_t mem_peak_footprint(void);
+unsigned long mem_grow_count(void);
@@ -1,6 +1,7 @@
 /* 
- * Simple, 32-bit and 64-bit clean allocator based on a doubly linked explicit free list,
- * first fit placement, and boundary tag coalescing. 
+ * Simple, 32-bit and 64-bit clean allocator based on segregated doubly linked
+ * explicit free lists, first fit placement within a size class, and boundary
+ * tag coalescing. 
  *
  * Blocks are aligned to double-word boundaries.  This yields 
  * 8-byte aligned blocks on a 32-bit processor, and 16-byte aligned
@@ -8,19 +9,149 @@
  * than necessary; the assignment only requires 8-byte alignment.  The
  * minimum block size is four words.
  *
+ * Only free blocks carry a footer.  Instead, every header records in its
+ * second lowest bit whether the previous block is allocated, so the footer
+ * of the previous block is only read when that block is free.
+ *
  * This allocator uses the size of a pointer, e.g., sizeof(void *), to
  * define the size of a word.  This allocator also uses the standard
  * type uintptr_t to define unsigned integers that are the same size
  * as a pointer, i.e., sizeof(uintptr_t) == sizeof(void *).
  *
+ * Building with MM_COMPACT set to 1 makes a word 32 bits wide instead, even
+ * on a 64-bit processor.  Headers and footers become 32-bit tags, blocks
+ * are aligned to 8 bytes and the minimum block shrinks to 16 bytes.  The
+ * links of the free lists become 32-bit offsets from the prologue, which is
+ * enough since no heap can grow past 4 GB.  The tree of large free blocks,
+ * the cache and the queues of remote frees keep full pointers, since the
+ * payloads of their blocks always have room for them.
+ *
+ * All the state of a heap is kept in an arena.  When built with MM_THREADS
+ * set to 1, every thread is bound to an arena of its own, with its own memlib
+ * region, on its first call.  Binding, and creating an arena when no released
+ * one is available, are the only steps that take the global arenas_lock.  A
+ * block freed by a thread other than the owner of its arena is pushed on the
+ * arena's lock-free queue of remote frees, and the owner drains that queue in
+ * one batch on its next allocation.  So the owner works on its arena without
+ * any lock.  A thread that reallocates a block of another thread's arena
+ * copies it to a block of its own and frees it remotely.  Only a heap made
+ * by mm_heap_create, which no thread owns, has a lock of its own.
+ *
  * ANATOMY OF BLOCKS:
  * Free block:		HEADER | PREV FREE | NEXT FREE | OLD DATA | FOOTER
- * Allocated block:	HEADER |--------------DATA----------------| FOOTER
+ * Allocated block:	HEADER |-------------------DATA-------------------|
+ *
+ * Free blocks are kept in NUM_CLASSES segregated lists.  Class 0 holds blocks
+ * of the minimum size, and every following class holds blocks up to twice the
+ * size of the previous one, up to TREE_MIN bytes.  Each list is NULL
+ * terminated and kept in LIFO order.  Larger free blocks are kept in a
+ * red-black tree ordered by size and then by address, whose nodes live in the
+ * payloads of the free blocks themselves, so they are placed best fit in
+ * O(log n) time:
+ *
+ * Tree node:		HEADER | LEFT | RIGHT | PARENT | COLOR | OLD DATA | FOOTER
+ *
+ * Building with MM_TLSF set to 1 replaces the power-of-two classes with a
+ * two-level segregated fit (TLSF) index.  The first level splits sizes by
+ * powers of two and the second level splits each of those ranges into
+ * SL_COUNT equal bins.  One bitmap records which first-level ranges hold a
+ * free block and one bitmap per range records which of its bins do, so
+ * find_fit, place and coalesce all run in constant time.  TLSF mode keeps
+ * every free block on a list and does not use the tree.
+ *
+ * In front of the heap, every arena keeps a cache of allocated blocks of up to
+ * CACHE_MAX bytes, with one LIFO bin per block size.  Freeing a small block
+ * pushes it on its bin and allocating one pops it, without touching the free
+ * lists, and a block stays marked allocated while it is cached.  An empty bin
+ * is refilled with a batch of blocks cut from one block of the heap, and a bin
+ * that reaches CACHE_LIMIT blocks gives its older half back to the heap.  The
+ * batch of a bin starts at one block and grows by one, up to CACHE_FILL, with
+ * every block freed into the bin, so that sizes which are never freed, or
+ * are freed by another thread, do not take blocks that will not be used.
+ * Building with MM_CACHE set to 0 turns the cache off.
+ *
+ * A free block before the epilogue is the top of the heap, which the arena
+ * keeps aside instead of in a free list.  find_fit only falls back on it
+ * when no other free block fits, place cuts blocks off its front by moving
+ * its header up, and the heap grows by merging new memory into it.  This
+ * way small requests do not break up the one large region at the end of
+ * the heap while holes elsewhere could serve them.
+ *
+ * By default the heap grows by at least CHUNKSIZE bytes at a time.  After
+ * mm_set_growth(MM_GROW_ADAPTIVE), every arena keeps a step of its own
+ * instead, which doubles, up to GROW_MAX, while the heap keeps growing
+ * within GROW_WINDOW allocations of the last time, and halves, down to
+ * CHUNKSIZE, when more than half of the heap is free as it grows.  The
+ * free bytes are counted as blocks enter and leave the free lists.
+ *
+ * When a free block at the top of the heap grows beyond MM_TRIM_THRESHOLD
+ * bytes, all but CHUNKSIZE bytes of it are given back to memlib.  mm_trim
+ * does the same on request, down to any amount of padding.  Elsewhere in
+ * the heap, a free block of at least MM_RELEASE_THRESHOLD bytes gives the
+ * whole pages between its links and its footer back with mem_release, so
+ * they no longer take memory until place hands them out again.
+ *
+ * Requests of MM_MMAP_THRESHOLD bytes or more do not come from the heap at
+ * all.  Each gets a mapping of its own from mem_map, outside every region,
+ * whose header has the MAPPED_BIT set, so freeing it unmaps it at once and
+ * it can neither fragment the heap nor pin its top.  Reallocating such a
+ * block resizes its mapping with mem_remap, which moves pages rather than
+ * copying them:
+ *
+ * Mapped block:	[GAP] | OFFSET | HEADER (LENGTH/MAPPED_BIT|1) |---DATA---|
+ *
+ * mm_malloc_batch hands out many blocks of one size at once, carving all
+ * that the cache cannot supply from a single fit.  mm_free_batch caches the
+ * small blocks as mm_free would and sorts only the others by address, so
+ * that every run of adjacent blocks is merged and coalesced with its
+ * neighbours once instead of block by block.
+ *
+ * mm_free_sized takes the size of the block from its caller, so a small
+ * block goes to its bin of the cache without its header being read, and
+ * mm_usable_size tells a caller how much payload its block really has.
+ *
+ * mm_memalign looks for a free block with room for a payload of the given
+ * alignment and gives the gap in front of that payload back to the free
+ * lists as a block of its own, so aligned requests do not have to be padded
+ * with a whole alignment of wasted space.
+ *
+ * mm_calloc skips zeroing memory that is known to be zero already.  Memory
+ * that memlib hands out for the first time reads as zero, so extend_heap
+ * marks a free block made from it with the FRESH_BIT, which place passes on
+ * to the remainder of a split.  Of a fresh block only its list or tree
+ * links and its footer can have been written, so that is all mm_calloc has
+ * to clear.  A block loses the bit once it has been allocated, and a block
+ * with a mapping of its own is always fresh.
+ *
+ * mm_get_stats reports the state of the heap without walking it.  Every
+ * arena counts its free bytes and blocks as they enter and leave the free
+ * lists, and its splits, merges, growths and shrinks as they happen, and
+ * keeps track of the largest node of the tree.
+ *
+ * Building with MM_INSTRUMENT set to 1 also counts, per arena, how many
+ * blocks each fit search visits, which neighbours each coalesce merges
+ * with, how often place splits a block and how each realloc is served, for
+ * mm_get_instrument to report.  Otherwise the counters compile to nothing.
+ *
+ * mm_heap_create makes a heap of its own: an arena with a fresh memlib
+ * region that no thread is bound to, served by mm_heap_malloc, mm_heap_free
+ * and mm_heap_realloc.  Such a heap never maps blocks outside its region,
+ * so mm_heap_destroy releases all of its blocks by unmapping the region.
+ *
+ * A region (mm_region_create) serves request-scoped objects from chunks of
+ * the default heap.  mm_region_alloc bumps a pointer through the current
+ * chunk, and mm_region_reset and mm_region_destroy give the chunks back in
+ * batches through mm_free_batch instead of freeing objects one by one.
  */
 
 #include <stdbool.h>
 #include <stdint.h>
+#if MM_THREADS
+#include <pthread.h>
+#endif
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "memlib.h"
@@ -43,59 +174,384 @@ team_t team = {
 	"201401403@daiict.ac.in"
 };
 
+/* Set MM_COMPACT to 1 for 32-bit headers, footers and free-list links. */
+#ifndef MM_COMPACT
+#define MM_COMPACT  0
+#endif
+
+/* An unsigned integer of the size of a word, which holds a header or footer. */
+#if MM_COMPACT
+typedef uint32_t tag_t;
+#else
+typedef uintptr_t tag_t;
+#endif
+
 /* Basic constants and macros: */
-#define WSIZE      sizeof(void *) /* Word and header/footer size (bytes) */
+#define WSIZE      sizeof(tag_t)  /* Word and header/footer size (bytes) */
 #define DSIZE      (2 * WSIZE)    /* Doubleword size (bytes) */
 #define CHUNKSIZE  (1 << 12)      /* Extend heap by this amount (bytes) */
+#define MINBLOCK   (4 * WSIZE)    /* Minimum block size (bytes) */
+#define GROW_MAX   (64 * 1024)    /* Largest adaptive growth step (bytes) */
+#define GROW_WINDOW  64           /* Allocations between growths that count as sustained */
+#define GROW_RATIO   8            /* A step is at most this fraction of the heap */
+#define NODE_SIZE  (4 * sizeof(char *)) /* Payload bytes that may hold free-block links */
+
+/* Set MM_THREADS to 1 to give every thread an arena of its own. */
+#ifndef MM_THREADS
+#define MM_THREADS  0
+#endif
+
+/* Set MM_CACHE to 0 to send every request straight to the heap. */
+#ifndef MM_CACHE
+#define MM_CACHE  1
+#endif
+
+/* Free space at the top of the heap beyond this is released (0: never). */
+#ifndef MM_TRIM_THRESHOLD
+#define MM_TRIM_THRESHOLD  (128 * 1024)
+#endif
+
+/* Free blocks of at least this many bytes give their inner pages back (0: never). */
+#ifndef MM_RELEASE_THRESHOLD
+#define MM_RELEASE_THRESHOLD  (256 * 1024)
+#endif
+
+/* Requests of at least this many bytes get a mapping of their own (0: never). */
+#ifndef MM_MMAP_THRESHOLD
+#define MM_MMAP_THRESHOLD  (128 * 1024)
+#endif
+
+/* Bytes that a region takes from the heap at a time for its small objects. */
+#ifndef MM_REGION_CHUNK
+#define MM_REGION_CHUNK  (8 * CHUNKSIZE)
+#endif
+
+/* Free-block index: 0 for power-of-two segregated lists, 1 for TLSF. */
+#ifndef MM_TLSF
+#define MM_TLSF  0
+#endif
+
+/* Set MM_INSTRUMENT to 1 to count probes, merges, placements and reallocations. */
+#ifndef MM_INSTRUMENT
+#define MM_INSTRUMENT  0
+#endif
+
+/* Index of the most significant set bit of x, which must be non-zero. */
+#define FLS(x)  ((int)(sizeof(unsigned long) * 8 - 1) - __builtin_clzl(x))
+
+/* The class of mm_stats_t that counts a free block of "size" bytes. */
+#define STATS_CLASS(size)  MIN(MAX(FLS(size) - 4, 0), MM_STATS_CLASSES - 1)
+
+#if MM_TLSF
+#define SL_LOG2      4                            /* log2 of bins per range */
+#define SL_COUNT     (1 << SL_LOG2)               /* Bins per first-level range */
+#define FL_SHIFT     (SL_LOG2 + (WSIZE == 8 ? 4 : 3)) /* log2(SMALL_BLOCK) */
+#define SMALL_BLOCK  ((size_t)1 << FL_SHIFT)      /* Sizes below are in range 0 */
+#define FL_COUNT     32                           /* First-level ranges */
+#define NUM_CLASSES  (FL_COUNT * SL_COUNT)        /* Number of TLSF bins */
+
+#else
+#define NUM_CLASSES  6            /* Number of segregated free lists */
+#define TREE_MIN     (MINBLOCK << (NUM_CLASSES - 1)) /* Larger blocks go to the tree */
+#endif
+
+#define CACHE_MAX    (DSIZE * ((256 + WSIZE + DSIZE - 1) / DSIZE)) /* Largest cached block */
+#define CACHE_BINS   ((int)((CACHE_MAX - MINBLOCK) / DSIZE) + 1) /* One bin per block size */
+#define CACHE_FILL   8   /* Largest batch taken from the heap at once */
+#define CACHE_LIMIT  32  /* Blocks in a bin before half of them are flushed */
+
+/* Bin of the cache that holds blocks of "asize" bytes. */
+#define CACHE_BIN(asize)  (((asize) - MINBLOCK) / DSIZE)
 
 #define MAX(x, y)  ((x) > (y) ? (x) : (y))  
+#define MIN(x, y)  ((x) < (y) ? (x) : (y))
 
 /* Pack a size and allocated bit into a word. */
 #define PACK(size, alloc)  ((size) | (alloc))
 
+/* Header bit recording that the previous block is allocated. */
+#define PREV_ALLOC_BIT  0x2
+
+/* Header bit marking a block that has a mapping of its own. */
+#define MAPPED_BIT  0x4
+
+/*
+ * Header bit marking a free block of the heap whose payload is zero but for
+ * its first NODE_SIZE bytes and its footer.  Only free blocks carry it, and no
+ * free block is mapped, so it shares its bit with MAPPED_BIT.
+ */
+#define FRESH_BIT  MAPPED_BIT
+
+/* Is a request of "size" bytes served by a mapping of its own? */
+#if MM_MMAP_THRESHOLD > 0
+#define IS_MAPPED_SIZE(size)  ((size) >= MM_MMAP_THRESHOLD)
+#else
+#define IS_MAPPED_SIZE(size)  false
+#endif
+
+/* Does the current arena serve a request of "size" bytes with a mapping? */
+#define ARENA_MAPS(size)  (IS_MAPPED_SIZE(size) && !arena->region_only)
+
 /* Read and write a word at address p. */
-#define GET(p)       (*(uintptr_t *)(p))
-#define PUT(p, val)  (*(uintptr_t *)(p) = (val))
+#define GET(p)       (*(tag_t *)(p))
+#define PUT(p, val)  (*(tag_t *)(p) = (val))
 
 /* Read the size and allocated fields from address p. */
 #define GET_SIZE(p)   (GET(p) & ~(DSIZE - 1))
 #define GET_ALLOC(p)  (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p)  (GET(p) & PREV_ALLOC_BIT)
+#define GET_MAPPED(p)  (GET(p) & MAPPED_BIT)
+#define GET_FRESH(p)  (GET(p) & FRESH_BIT)
+
+/* Read the size field at address p while another thread may change the other bits. */
+#define GET_SIZE_SHARED(p)  (__atomic_load_n((tag_t *)(p), __ATOMIC_RELAXED) & ~(DSIZE - 1))
+
+/* Set or clear the previous-allocated bit of the header at address p. */
+#define SET_PREV_ALLOC(p)  (GET(p) |= PREV_ALLOC_BIT)
+#define CLR_PREV_ALLOC(p)  (GET(p) &= ~(tag_t)PREV_ALLOC_BIT)
+
+/* Mark the free block whose header is at address p as fresh. */
+#define SET_FRESH(p)  (GET(p) |= FRESH_BIT)
 
-/* Given block ptr bp, compute address of its header and footer. */
+/* Given block ptr bp, compute address of its header and footer (free blocks only). */
 #define HDRP(bp)  ((char *)(bp) - WSIZE)
 #define FTRP(bp)  ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks. */
+/* Given block ptr bp, compute address of next and previous blocks.  PREV_BLKP is only valid if the previous block is free. */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* Read and write a free-list link, one word wide, at address p. */
+#if MM_COMPACT
+/* A link is the offset of the block from the prologue, or 0 for NULL. */
+#define GET_LINK(p)  (GET(p) != 0 ? arena->heap_listp + GET(p) : NULL)
+#define PUT_LINK(p, qp)  PUT(p, (qp) != NULL ? (tag_t)((char *)(qp) - arena->heap_listp) : 0)
+#else
+#define GET_LINK(p)  (*(char **)(p))
+#define PUT_LINK(p, qp)  (*(char **)(p) = (qp))
+#endif
+
 /* Given ptr bp in free list, get next and previous ptr in the list. */
-/* Since minimum block size is 4 * WSIZE, we can store the address of previous next block in the list through pointers. */
-#define GET_NEXT_PTR(bp)  (*(char **)(bp + WSIZE))
-#define GET_PREV_PTR(bp)  (*(char **)(bp))
+/* Since minimum block size is MINBLOCK, we can store the address of previous next block in the list through links. */
+#define GET_NEXT_PTR(bp)  GET_LINK((char *)(bp) + WSIZE)
+#define GET_PREV_PTR(bp)  GET_LINK(bp)
 
 /* Puts pointers in the next and previous elements of free list */
-#define SET_NEXT_PTR(bp, qp) (GET_NEXT_PTR(bp) = qp)
-#define SET_PREV_PTR(bp, qp) (GET_PREV_PTR(bp) = qp)
+#define SET_NEXT_PTR(bp, qp) PUT_LINK((char *)(bp) + WSIZE, qp)
+#define SET_PREV_PTR(bp, qp) PUT_LINK(bp, qp)
+
+/* The top of the current arena if it has at least "asize" bytes, or NULL. */
+#define TOP_FIT(asize)  (arena->top != NULL && GET_SIZE(HDRP(arena->top)) >= (asize) ? \
+			 arena->top : NULL)
+
+/*
+ * Hot-path counters of the current arena, which compile to nothing without
+ * MM_INSTRUMENT.  PROBE counts a block visited by a fit search and
+ * COUNT_PROBES files the search under its bucket and starts the next one.
+ */
+#if MM_INSTRUMENT
+#define COUNT(field)    (arena->inst.field++)
+#define PROBE()         (arena->probes++)
+#define COUNT_PROBES()  (arena->inst.probes[arena->probes <= 1 ? (int)arena->probes : \
+			 MIN(FLS(arena->probes - 1) + 2, MM_PROBE_BINS - 1)]++, \
+			 arena->probes = 0)
+#else
+#define COUNT(field)
+#define PROBE()
+#define COUNT_PROBES()
+#endif
+
+/* Given ptr bp of a mapped block, get its offset from the start of its mapping. */
+#define MAP_OFFSET(bp)  (*(tag_t *)((char *)(bp) - DSIZE))
+
+/* Given ptr bp in a bin of the cache, get the next block in the bin. */
+#define CACHE_NEXT(bp)  (*(char **)(bp))
+
+/* Given ptr bp in a queue of remote frees, get the next block in the queue. */
+#define REMOTE_NEXT(bp)  (*(char **)(bp))
+
+#if !MM_TLSF
+/* Given ptr bp in the tree, get its children, parent and color. */
+#define TREE_LEFT(bp)    (*(char **)(bp))
+#define TREE_RIGHT(bp)   (*(char **)((char *)(bp) + sizeof(char *)))
+#define TREE_PARENT(bp)  (*(char **)((char *)(bp) + 2 * sizeof(char *)))
+#define TREE_COLOR(bp)   (*(uintptr_t *)((char *)(bp) + 3 * sizeof(char *)))
+
+#define RED    1
+#define BLACK  0
+
+/* Returns true if the color of node bp, which may be NULL, is red. */
+#define IS_RED(bp)  ((bp) != NULL && TREE_COLOR(bp) == RED)
+#endif
+
+/* 
+ * The state of one heap.  Every routine below works on the arena that
+ * "arena" points to.  Without MM_THREADS that is main_arena, whose heap is
+ * the default memlib region, except inside the mm_heap_* routines.  The
+ * mm_heap_t handle of the public interface is an arena.
+ */
+typedef struct mm_heap {
+	mem_region_t *region;         /* Simulated memory holding the heap */
+	char *heap_listp;             /* Pointer to first block */
+	char *top;                    /* Free block before the epilogue, or NULL */
+	char *seg_lists[NUM_CLASSES]; /* Heads of the segregated free lists */
+#if MM_TLSF
+	uint32_t fl_bitmap;           /* Ranges with a non-empty bin */
+	uint32_t sl_bitmap[FL_COUNT]; /* Non-empty bins of each range */
+#else
+	char *tree_root;              /* Root of the tree of large free blocks */
+	char *tree_max;               /* Largest block in the tree */
+#endif
+	char *cache[CACHE_BINS];      /* Bins of cached small blocks */
+	unsigned cache_count[CACHE_BINS]; /* Number of blocks in each bin */
+	unsigned cache_batch[CACHE_BINS]; /* Blocks to take on the next refill */
+	mm_cache_stats_t cache_stats; /* Cache counters since arena_init */
+	mm_stats_t stats;             /* Heap counters since arena_init */
+	size_t blocks;                /* Blocks in the heap, free or not */
+#if MM_INSTRUMENT
+	mm_instrument_t inst;         /* Hot-path counters since arena_init */
+	unsigned long probes;         /* Blocks visited by the current fit search */
+#endif
+	size_t grow_step;             /* Least amount to extend the heap by */
+	unsigned long since_grow;     /* Heap allocations since the heap last grew */
+	bool region_only;             /* Made by mm_heap_create, so nothing is mapped */
+#if MM_THREADS
+	pthread_mutex_t lock;         /* Held by every operation on a heap of mm_heap_create */
+	char *remote_frees;           /* Blocks freed by other threads, pushed lock-free */
+	bool owned;                   /* Bound to a running thread? */
+	struct mm_heap *next;         /* Next arena in the list of all arenas */
+#endif
+} arena_t;
+
+/*
+ * The state of one region.  Its chunks are blocks of the default heap,
+ * linked through their first double word, with the chunk that objects are
+ * bumped from kept apart so that mm_region_reset can hold on to it.
+ */
+typedef struct mm_region {
+	char *chunks;                 /* Other chunks, newest first */
+	char *bump;                   /* Chunk that small objects come from, or NULL */
+	char *next;                   /* Next free byte of the bump chunk */
+	char *end;                    /* End of the bump chunk */
+} region_t;
+
+/* The chunk after chunk "cp" in the list of a region. */
+#define CHUNK_NEXT(cp)  (*(char **)(cp))
 
 /* Global variables: */
-static char *heap_listp = 0; /* Pointer to first block */
-static char *free_listp = 0;  
+#if MM_THREADS
+static arena_t main_arena;
+static arena_t *arenas = &main_arena;  /* List of all arenas, newest first */
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER; /* Guards binding */
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t arena_key;        /* Releases the arena of an exiting thread */
+static __thread arena_t *thread_arena; /* Arena bound to this thread */
+static __thread arena_t *arena;        /* Arena being worked on */
+#else
+static arena_t main_arena;
+static arena_t *arena = &main_arena;   /* Arena being worked on */
+#endif
+static int growth = MM_GROW_FIXED;     /* Heap growth policy of every arena */
+static size_t mapped_bytes;            /* Bytes in blocks with mappings of their own */
+static size_t mapped_blocks;           /* Blocks with mappings of their own */
+
+/* Function prototypes for the routines that work on the current arena: */
+static int arena_init(void);
+static void *arena_malloc(size_t size);
+static void arena_free(void *bp);
+static void *arena_realloc(void *bp, size_t size);
+static size_t arena_malloc_batch(size_t size, size_t n, void **out);
+static void arena_free_batch(void **ptrs, size_t n);
+static void *arena_memalign(size_t alignment, size_t size);
+static void *arena_calloc(size_t size);
+static void arena_stats(mm_stats_t *stats);
+
+#if MM_THREADS
+/* Function prototypes for binding threads to arenas: */
+static arena_t *arena_bind(void);
+static void arena_release(void *a);
+static void arena_make_key(void);
+static arena_t *arena_of(void *bp);
+static void arena_remote_free(arena_t *a, void *bp);
+static void arena_drain(void);
+static bool arena_own(void);
+static void arena_enter(arena_t *a);
+static void arena_leave(void);
+#define OWN_ENTER()     arena_own()
+#define OWN_LEAVE()     (arena = NULL)
+#define ARENA_ENTER(a)  (arena = (a))
+#define ARENA_LEAVE()   (arena = NULL)
+#else
+#define OWN_ENTER()     (true)
+#define OWN_LEAVE()
+#define ARENA_ENTER(a)
+#define ARENA_LEAVE()
+#endif
+
+/* Work on the arena of a heap made by mm_heap_create, and leave it again. */
+#if MM_THREADS
+#define HEAP_ENTER(h)  arena_enter(h)
+#define HEAP_LEAVE()   arena_leave()
+#else
+#define HEAP_ENTER(h)  (arena = (h))
+#define HEAP_LEAVE()   (arena = &main_arena)
+#endif
+
+/* Function prototypes for the cache and the heap behind it: */
+static void *cache_fill(size_t asize);
+static void cache_push(void *bp, int bin);
+static void block_carve(void *bp, size_t asize, size_t n);
+static void cache_flush(int bin);
+static void *block_alloc(size_t asize);
+static void block_free(void *bp);
+static void trim_block(void *bp, size_t asize);
+static void release_pages(void *bp, char *lo, char *hi);
+static void cache_empty(void);
+static int arena_trim(size_t pad);
+static size_t grow_size(size_t asize);
+
+/* Function prototypes for blocks with mappings of their own: */
+static void *map_alloc(size_t size, size_t alignment);
+static void map_free(void *bp);
+static void *map_realloc(void *bp, size_t size);
 
 /* Function prototypes for internal helper routines: */
 static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
 static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
+static void *find_aligned_fit(size_t asize, size_t alignment);
+static void *place_aligned(void *bp, size_t asize, size_t alignment);
+static size_t aligned_gap(void *bp, size_t alignment);
 
 /* Function prototypes for maintaining free list*/
 static void insert_in_free_list(void *bp); 
 static void remove_from_free_list(void *bp);
+static int size_class(size_t asize);
+#if MM_TLSF
+static size_t class_min(int class);
+#endif
+static size_t adjust_size(size_t size);
+static int ptr_compare(const void *p, const void *q);
+
+#if !MM_TLSF
+/* Function prototypes for maintaining the tree of large free blocks: */
+static void tree_insert(void *bp);
+static void tree_remove(void *bp);
+static void *tree_best_fit(size_t asize);
+static void tree_rotate(void *bp, bool left);
+static void tree_transplant(void *bp, void *child);
+static bool tree_less(void *bp, void *qp);
+#endif
 
 /* Function prototypes for heap consistency checker routines: */
-static void checkblock(void *bp);
-static void checkheap(bool verbose);
+static int report(const char *fmt, ...);
+static int checkblock(void *bp);
+static int checkheap(bool verbose);
 static void printblock(void *bp); 
+#if !MM_TLSF
+static int checktree(void *bp, size_t limit, size_t *nodes, int *errors);
+#endif
 
 /* 
  * Requires:
@@ -104,31 +560,36 @@ static void printblock(void *bp);
  * Effects:
  *   Initialize the memory manager.  Returns 0 if the memory manager was
  *   successfully initialized and -1 otherwise.
- *	 The initial heap looks like this: 
- * 	 ||PADDING|PROLOGUE HEADER (2 * DSIZE/1)|PROLOGUE PREV PTR (0)|PROLOGUE NEXT PTR (0)|PROLOGUE FOOTER (2 * DSIZE/1)|EPILOGUE (0/1)||
- * 	 Each part is of 8 bytes.
- * 	 EPILOGUE signals the end of the heap.
- * 	 PROLOGUE PREV PTR signals the end of the free list.
+ *   With MM_THREADS, every arena is emptied, so no other thread may be using
+ *   the allocator during the call.  The caller has already reset the brk of
+ *   the default region, which also let go of the mappings of large blocks,
+ *   so their counts start over here.
  */
 int 
 mm_init(void) 
 {
-	/* Create the initial empty heap. */
-	if ((heap_listp = mem_sbrk(6 * WSIZE)) == (void *)-1)
-		return (-1);
-	PUT(heap_listp, 0);                            		/* Alignment padding */
-	PUT(heap_listp + (1 * WSIZE), PACK(2 * DSIZE, 1)); 	/* Prologue header */ 
-	PUT(heap_listp + (2 * WSIZE), 0);					/* Prologue previous pointer */
-	PUT(heap_listp + (3 * WSIZE), 0);					/*Prologue next pointer */
-	PUT(heap_listp + (4 * WSIZE), PACK(2 * DSIZE, 1)); 	/* Prologue footer */ 
-	PUT(heap_listp + (5 * WSIZE), PACK(0, 1));     		/* Epilogue header */
-	heap_listp += (2 * WSIZE);							/* heap_listp now points to payload of prologue. */
-	free_listp = heap_listp;							/* Setting end of free list as prologue. */
-
-	/* Extend the empty heap with a free block of CHUNKSIZE bytes. */
-	if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
+#if MM_THREADS
+	arena_t *a;
+	int result = 0;
+#endif
+
+	__atomic_store_n(&mapped_bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&mapped_blocks, 0, __ATOMIC_RELAXED);
+#if MM_THREADS
+	if (thread_arena == NULL && arena_bind() == NULL)
 		return (-1);
-	return (0);
+	for (a = arenas; a != NULL; a = a->next) {
+		if (a != &main_arena)
+			mem_region_reset_brk(a->region);
+		ARENA_ENTER(a);
+		if (arena_init() < 0)
+			result = -1;
+		ARENA_LEAVE();
+	}
+	return (result);
+#else
+	return (arena_init());
+#endif
 }
 
 /* 
@@ -143,55 +604,56 @@ mm_init(void)
 void *
 mm_malloc(size_t size) 
 {
-	size_t asize;      /* Adjusted block size */
-	size_t extendsize; /* Amount to extend heap if no fit */
 	void *bp;
 
-	/* Ignore spurious requests. */
-	if (size <= 0)
-		return (NULL);
-
-	/* Adjust block size to include overhead and alignment reqs. */
-	if (size <= DSIZE)
-		asize = 2 * DSIZE;
-	else
-		asize = DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE);
-
-	/* Search the free list for a fit. */
-	if ((bp = find_fit(asize)) != NULL) {
-		place(bp, asize);
-		return (bp);
-	}
-
-	/* No fit found.  Get more memory and place the block. */
-	extendsize = MAX(asize, CHUNKSIZE);
-	if ((bp = extend_heap(extendsize / WSIZE)) == NULL)  
+	if (!OWN_ENTER())
 		return (NULL);
-	place(bp, asize);
+	bp = arena_malloc(size);
+	OWN_LEAVE();
 	return (bp);
-} 
+}
 
 /* 
  * Requires:
  *   "bp" is either the address of an allocated block or NULL.
  *
  * Effects:
- *   Free a block and coalesce.
+ *   Free a block and coalesce.  The block goes back to the arena that it
+ *   was allocated from.  With MM_THREADS, a block of another thread's arena
+ *   is queued for that thread without taking any lock.  A block with a
+ *   mapping of its own is unmapped by whichever thread frees it.
  */
 void
 mm_free(void *bp)
 {
-	size_t size;
+#if MM_THREADS
+	arena_t *a;
+#endif
 
 	/* Ignore spurious requests. */
 	if (bp == NULL)
 		return;
 
-	/* Free and coalesce the block. */
-	size = GET_SIZE(HDRP(bp));
-	PUT(HDRP(bp), PACK(size, 0));
-	PUT(FTRP(bp), PACK(size, 0));
-	coalesce(bp);
+#if MM_THREADS
+	/* The header may be changing under the owner's lock; look up the region instead. */
+	if ((a = arena_of(bp)) == NULL) {
+		map_free(bp);
+		return;
+	}
+	if (a != thread_arena) {
+		arena_remote_free(a, bp);
+		return;
+	}
+#else
+	if (GET_MAPPED(HDRP(bp))) {
+		map_free(bp);
+		return;
+	}
+#endif
+	/* The block is of the thread's own arena, so the thread has one. */
+	ARENA_ENTER(thread_arena);
+	arena_free(bp);
+	ARENA_LEAVE();
 }
 
 /*
@@ -199,71 +661,1859 @@ mm_free(void *bp)
  *   "ptr" is either the address of an allocated block or NULL.
  *
  * Effects:
- *   Reallocates the block "ptr" to a block with at least "size" bytes of payload, unless "size" is zero.  
- *	 If "size" is zero, frees the block "ptr" and returns NULL.  
- * 	 If the block "ptr" is already a block with at least "size" bytes of payload, then "ptr" is returned.
- *   If "size" is more than the size of "ptr" block,
- * 	 if the next block is free, extract space from that if possible, 
- *	 else a new block is allocated and the contents of the old block "ptr" are copied to that new block.
- *   Returns the address of this new block if the allocation was successful and NULL otherwise.
+ *   Reallocates the block "ptr" to a block with at least "size" bytes of
+ *   payload, as described at arena_realloc, in the arena of the calling
+ *   thread.  With MM_THREADS, a block of another thread's arena is not
+ *   touched there: its payload is copied to a new block of the calling
+ *   thread's arena, and it is queued for its owner as mm_free would.
  */
 void * 
 mm_realloc(void * bp, size_t size)
 {
-  if((int)size < 0) 
-    return NULL; 
-  
-  else if((int)size == 0){ 
-    mm_free(bp); 
-    return NULL; 
-  } 
+	void *newp;
+#if MM_THREADS
+	arena_t *a;
+	size_t oldsize;
+
+	if (bp != NULL && (a = arena_of(bp)) != NULL && a != thread_arena) {
+		if ((int)size < 0)
+			return (NULL);
+		if (size > 0) {
+			if ((newp = mm_malloc(size)) == NULL)
+				return (NULL);
+			oldsize = GET_SIZE_SHARED(HDRP(bp));
+			memcpy(newp, bp, MIN(size, oldsize - WSIZE));
+		} else
+			newp = NULL;
+		arena_remote_free(a, bp);
+		return (newp);
+	}
+#endif
+	if (!OWN_ENTER())
+		return (NULL);
+	newp = arena_realloc(bp, size);
+	OWN_LEAVE();
+	return (newp);
+}
+
+/*
+ * Requires:
+ *   "out" points to an array of at least "n" pointers.
+ *
+ * Effects:
+ *   Allocate "n" blocks with at least "size" bytes of payload each, as
+ *   described at arena_malloc_batch, and store their addresses in
+ *   out[0] to out[n - 1].  Returns the number of blocks allocated, which
+ *   is less than "n", with the rest of "out" untouched, if memory ran out.
+ */
+size_t
+mm_malloc_batch(size_t size, size_t n, void **out)
+{
+	size_t count;
+
+	if (!OWN_ENTER())
+		return (0);
+	count = arena_malloc_batch(size, n, out);
+	OWN_LEAVE();
+	return (count);
+}
+
+/*
+ * Requires:
+ *   "ptrs" points to an array of "n" pointers, each either the address of
+ *   an allocated block or NULL, with no block appearing twice.
+ *
+ * Effects:
+ *   Free every block of the array, as described at arena_free_batch.  The
+ *   array is overwritten in the process.
+ */
+void
+mm_free_batch(void **ptrs, size_t n)
+{
+	size_t i;
+
+	if (!OWN_ENTER()) {
+		/* A thread with no arena of its own can only free remotely. */
+		for (i = 0; i < n; i++)
+			mm_free(ptrs[i]);
+		return;
+	}
+	arena_free_batch(ptrs, n);
+	OWN_LEAVE();
+}
+
+/*
+ * Requires:
+ *   "bp" is either the address of an allocated block or NULL.  "size" is
+ *   at least the size last asked for the block by mm_malloc, mm_realloc or
+ *   their batch and aligned forms, and at most mm_usable_size(bp).
+ *
+ * Effects:
+ *   Free a block, as mm_free does.  Since "size" tells both the bin of the
+ *   cache that the block belongs to and that the block is not mapped, a
+ *   small block of the calling thread's arena is cached without its header
+ *   being read.  A block that "size" puts in a bin smaller than the block
+ *   is still correct to hand out from that bin.  Other blocks take the
+ *   path of mm_free.
+ */
+void
+mm_free_sized(void *bp, size_t size)
+{
+	size_t asize = adjust_size(size);
+#if MM_THREADS
+	arena_t *a;
+#endif
 
-else if(size > 0){ 
-  	/* If bp is NULL, then this is just malloc. */
-    if(bp == NULL) {
-		return mm_malloc(size);
+	if (bp == NULL || !MM_CACHE || asize == 0 || asize > CACHE_MAX || IS_MAPPED_SIZE(size)) {
+		mm_free(bp);
+		return;
+	}
+#if MM_THREADS
+	if ((a = arena_of(bp)) != thread_arena) {
+		arena_remote_free(a, bp);
+		return;
 	}
+#endif
+	ARENA_ENTER(thread_arena);
+	cache_push(bp, CACHE_BIN(asize));
+	ARENA_LEAVE();
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Allocate a block with at least "size" bytes of payload whose address
+ *   is a multiple of "alignment", as described at arena_memalign.  Returns
+ *   the address of this block, or NULL if "alignment" is not a power of two,
+ *   "size" is zero or the allocation failed.
+ */
+void *
+mm_memalign(size_t alignment, size_t size)
+{
+	void *bp;
+
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+		return (NULL);
+
+	/* Every block is aligned to DSIZE already. */
+	if (alignment <= DSIZE)
+		return (mm_malloc(size));
+
+	if (!OWN_ENTER())
+		return (NULL);
+	bp = arena_memalign(alignment, size);
+	OWN_LEAVE();
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   The C11 aligned_alloc: the same as mm_memalign.  "size" need not be a
+ *   multiple of "alignment".
+ */
+void *
+mm_aligned_alloc(size_t alignment, size_t size)
+{
+	return (mm_memalign(alignment, size));
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Allocate a block for an array of "nmemb" elements of "size" bytes each
+ *   and set all of its bytes to zero, as described at arena_calloc.  Returns
+ *   the address of this block, or NULL if the array is empty, its size does
+ *   not fit in a size_t or the allocation failed.
+ */
+void *
+mm_calloc(size_t nmemb, size_t size)
+{
+	void *bp;
+
+	if (nmemb != 0 && size > SIZE_MAX / nmemb)
+		return (NULL);
 
-    size_t oldsize = GET_SIZE(HDRP(bp)); 
-    size_t asize;							/* Valid requested block size */
+	if (!OWN_ENTER())
+		return (NULL);
+	bp = arena_calloc(nmemb * size);
+	OWN_LEAVE();
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "bp" is either the address of an allocated block or NULL.
+ *
+ * Effects:
+ *   Returns the number of bytes of payload that the block really has,
+ *   which may be more than was asked for, since sizes are rounded up and
+ *   a block keeps any remainder too small to split off.  The caller may
+ *   use all of it.  Returns 0 if "bp" is NULL.
+ */
+size_t
+mm_usable_size(void *bp)
+{
+	size_t size;
+#if MM_THREADS
+	arena_t *a;
+#endif
 
-    /* Aligning and adding overheads. */
-    if (size <= DSIZE)
-		asize = 2 * DSIZE;
+	if (bp == NULL)
+		return (0);
+#if MM_THREADS
+	if ((a = arena_of(bp)) == NULL)
+		return (GET_SIZE(HDRP(bp)) - MAP_OFFSET(bp));
+	/* The owner of the arena may be changing the other bits of the header. */
+	size = GET_SIZE_SHARED(HDRP(bp)) - WSIZE;
+#else
+	if (GET_MAPPED(HDRP(bp)))
+		size = GET_SIZE(HDRP(bp)) - MAP_OFFSET(bp);
 	else
-		asize = DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE);
-
-    /* If newsize is less than or equal to oldsize, return the pointer. */
-    if(asize <= oldsize){ 
-        return bp; 
-    }
-    
-    /* Now, asize is greater than oldsize */ 
-    else { 
-        size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp))); 
-        size_t csize = oldsize + GET_SIZE(HDRP(NEXT_BLKP(bp)));
-      	/* 
-      	 * If next block is free and the size of the two blocks is greater than 
-         * or equal to the new size, then we only need to combine both the blocks.  
-         */ 
-        if(!next_alloc && csize >= asize){ 
-        	remove_from_free_list(NEXT_BLKP(bp)); 
-            PUT(HDRP(bp), PACK(csize, 1)); 
-            PUT(FTRP(bp), PACK(csize, 1)); 
-            return bp; 
-        }
-        /* If it couldn't fit, create a new block. */
-        else {  
-            void * new_ptr = mm_malloc(size);  
-            memcpy(new_ptr, bp, oldsize); 
-            mm_free(bp); 
-            return new_ptr; 
-        } 
-    }
-}
-else 
-    return NULL;
-} 
+		size = GET_SIZE(HDRP(bp)) - WSIZE;
+#endif
+	return (size);
+}
+
+/*
+ * Requires:
+ *   With MM_THREADS, no other thread is using the allocator, since the
+ *   arenas of other threads are read without a lock.
+ *
+ * Effects:
+ *   Check the heap of every arena for consistency, printing every problem
+ *   found, and every block if "verbose" is non-zero.  The check takes time
+ *   linear in the size of the heaps, so it can run after every request of
+ *   a long trace.  Returns the number of problems found, which is 0 if the
+ *   heaps are consistent.
+ */
+int
+mm_checkheap(int verbose)
+{
+	int errors = 0;
+#if MM_THREADS
+	arena_t *a;
+
+	for (a = __atomic_load_n(&arenas, __ATOMIC_ACQUIRE); a != NULL;
+	    a = a->next) {
+		ARENA_ENTER(a);
+		if (arena->heap_listp != NULL)
+			errors += checkheap(verbose != 0);
+		ARENA_LEAVE();
+	}
+#else
+	if (arena->heap_listp != NULL)
+		errors = checkheap(verbose != 0);
+#endif
+	return (errors);
+}
+
+/*
+ * Requires:
+ *   "stats" points to a structure that the counters can be stored in.
+ *   With MM_THREADS, no other thread is using the allocator.
+ *
+ * Effects:
+ *   Store the counters of the small-object cache, summed over all arenas,
+ *   in "*stats".  Each arena counts from its last initialization by mm_init.
+ */
+void
+mm_get_cache_stats(mm_cache_stats_t *stats)
+{
+#if MM_THREADS
+	arena_t *a;
+
+	memset(stats, 0, sizeof(*stats));
+	for (a = __atomic_load_n(&arenas, __ATOMIC_ACQUIRE); a != NULL;
+	    a = a->next) {
+		ARENA_ENTER(a);
+		stats->hits += arena->cache_stats.hits;
+		stats->misses += arena->cache_stats.misses;
+		stats->frees += arena->cache_stats.frees;
+		stats->flushes += arena->cache_stats.flushes;
+		ARENA_LEAVE();
+	}
+#else
+	*stats = main_arena.cache_stats;
+#endif
+}
+
+/*
+ * Requires:
+ *   "stats" points to a structure that the counters can be stored in.
+ *   With MM_THREADS, no other thread is using the allocator.
+ *
+ * Effects:
+ *   Store the counters of the heap, summed over all arenas, in "*stats".
+ *   The counters are kept up to date as blocks are split, merged and moved
+ *   in and out of the free lists, so reading them takes constant time per
+ *   arena, apart from largest_free as described at arena_stats.  Blocks in
+ *   the cache count as allocated.  The event counters of each arena count
+ *   from its last initialization by mm_init.
+ */
+void
+mm_get_stats(mm_stats_t *stats)
+{
+#if MM_THREADS
+	arena_t *a;
+#endif
+
+	memset(stats, 0, sizeof(*stats));
+#if MM_THREADS
+	for (a = __atomic_load_n(&arenas, __ATOMIC_ACQUIRE); a != NULL;
+	    a = a->next) {
+		ARENA_ENTER(a);
+		arena_stats(stats);
+		ARENA_LEAVE();
+	}
+#else
+	arena_stats(stats);
+#endif
+	stats->mapped_bytes = __atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED);
+	stats->mapped_blocks = __atomic_load_n(&mapped_blocks, __ATOMIC_RELAXED);
+}
+
+/*
+ * Requires:
+ *   "stats" points to a structure that the counters can be stored in.
+ *   With MM_THREADS, no other thread is using the allocator.
+ *
+ * Effects:
+ *   Store the hot-path counters, summed over all arenas, in "*stats".  Each
+ *   arena counts from its last initialization by mm_init.  Returns 0, or -1
+ *   with "*stats" cleared if mm.c was built without MM_INSTRUMENT.
+ */
+int
+mm_get_instrument(mm_instrument_t *stats)
+{
+#if MM_INSTRUMENT
+#if MM_THREADS
+	arena_t *a;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (a = __atomic_load_n(&arenas, __ATOMIC_ACQUIRE); a != NULL;
+	    a = a->next) {
+		ARENA_ENTER(a);
+		for (i = 0; i < MM_PROBE_BINS; i++)
+			stats->probes[i] += arena->inst.probes[i];
+		for (i = 0; i < 4; i++)
+			stats->coalesce[i] += arena->inst.coalesce[i];
+		stats->place_split += arena->inst.place_split;
+		stats->place_whole += arena->inst.place_whole;
+		stats->realloc_inplace += arena->inst.realloc_inplace;
+		stats->realloc_slid += arena->inst.realloc_slid;
+		stats->realloc_copied += arena->inst.realloc_copied;
+		ARENA_LEAVE();
+	}
+#else
+	*stats = main_arena.inst;
+#endif
+	return (0);
+#else
+	memset(stats, 0, sizeof(*stats));
+	return (-1);
+#endif
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Choose how the heap grows when no free block fits: MM_GROW_FIXED grows
+ *   it by at least CHUNKSIZE bytes and MM_GROW_ADAPTIVE by a step that
+ *   follows demand, as described at grow_size.  The policy takes effect the
+ *   next time a heap grows.  Returns the previous policy, or -1 if "policy"
+ *   is not one of these.
+ */
+int
+mm_set_growth(int policy)
+{
+	int old = growth;
+
+	if (policy != MM_GROW_FIXED && policy != MM_GROW_ADAPTIVE)
+		return (-1);
+	growth = policy;
+	return (old);
+}
+
+/*
+ * Requires:
+ *   With MM_THREADS, no other thread is using the allocator, since every
+ *   arena is trimmed.
+ *
+ * Effects:
+ *   Give the free memory at the top of the heap back to memlib, keeping
+ *   at least "pad" bytes of it for future requests.  The cache is emptied
+ *   first, so that cached blocks do not pin the top of the heap.  With
+ *   MM_THREADS every arena is trimmed.  Returns 1 if any memory was
+ *   released and 0 otherwise.
+ */
+int
+mm_trim(size_t pad)
+{
+	int released = 0;
+#if MM_THREADS
+	arena_t *a;
+
+	for (a = __atomic_load_n(&arenas, __ATOMIC_ACQUIRE); a != NULL;
+	    a = a->next) {
+		ARENA_ENTER(a);
+		arena_drain();
+		cache_empty();
+		released |= arena_trim(pad);
+		ARENA_LEAVE();
+	}
+#else
+	cache_empty();
+	released = arena_trim(pad);
+#endif
+	return (released);
+}
+
+/*
+ * The following routines work on heaps of their own.  The mm_* routines
+ * above serve the default heap, which is main_arena (or, with MM_THREADS,
+ * the arena bound to the calling thread); a heap made by mm_heap_create is
+ * an arena with a region of its own that no thread is bound to.
+ */
+
+/*
+ * Requires:
+ *   Nothing.
+ *
+ * Effects:
+ *   Create a new heap with its own memlib region and free lists.  The heap
+ *   keeps every block in its region, even those of MM_MMAP_THRESHOLD bytes
+ *   or more, so that mm_heap_destroy can release it all at once.  Returns
+ *   the heap, or NULL if it could not be created.
+ */
+mm_heap_t *
+mm_heap_create(void)
+{
+	arena_t *h;
+	int error;
+
+	if ((h = calloc(1, sizeof(arena_t))) == NULL)
+		return (NULL);
+	if ((h->region = mem_region_create()) == NULL) {
+		free(h);
+		return (NULL);
+	}
+	h->region_only = true;
+#if MM_THREADS
+	pthread_mutex_init(&h->lock, NULL);
+#endif
+	HEAP_ENTER(h);
+	error = arena_init();
+	HEAP_LEAVE();
+	if (error < 0) {
+		mm_heap_destroy(h);
+		return (NULL);
+	}
+	return (h);
+}
+
+/*
+ * Requires:
+ *   "heap" was returned by mm_heap_create and has not been destroyed.
+ *
+ * Effects:
+ *   mm_malloc for "heap".
+ */
+void *
+mm_heap_malloc(mm_heap_t *heap, size_t size)
+{
+	void *bp;
+
+	HEAP_ENTER(heap);
+	bp = arena_malloc(size);
+	HEAP_LEAVE();
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "bp" is either NULL or the address of an allocated block of "heap".
+ *   Blocks of a heap must go back to that heap, never to mm_free.
+ *
+ * Effects:
+ *   mm_free for "heap".
+ */
+void
+mm_heap_free(mm_heap_t *heap, void *bp)
+{
+	/* Ignore spurious requests. */
+	if (bp == NULL)
+		return;
+
+	HEAP_ENTER(heap);
+	arena_free(bp);
+	HEAP_LEAVE();
+}
+
+/*
+ * Requires:
+ *   "bp" is either NULL or the address of an allocated block of "heap".
+ *
+ * Effects:
+ *   mm_realloc for "heap".  The resulting block is also a block of "heap".
+ */
+void *
+mm_heap_realloc(mm_heap_t *heap, void *bp, size_t size)
+{
+	void *newp;
+
+	HEAP_ENTER(heap);
+	newp = arena_realloc(bp, size);
+	HEAP_LEAVE();
+	return (newp);
+}
+
+/*
+ * Requires:
+ *   "heap" was returned by mm_heap_create, and no thread is using it.
+ *
+ * Effects:
+ *   Release "heap" with every block still allocated from it.  This takes
+ *   a single unmapping of its region however many blocks it holds; the
+ *   blocks are not visited.
+ */
+void
+mm_heap_destroy(mm_heap_t *heap)
+{
+	mem_region_destroy(heap->region);
+#if MM_THREADS
+	pthread_mutex_destroy(&heap->lock);
+#endif
+	free(heap);
+}
+
+/*
+ * The following routines work on regions, whose objects are bumped off
+ * chunks of the default heap and are freed all at once.  A region is used
+ * by one thread at a time.
+ */
+
+/*
+ * Requires:
+ *   Nothing.
+ *
+ * Effects:
+ *   Create a new, empty region.  Returns the region, or NULL if it could
+ *   not be created.
+ */
+mm_region_t *
+mm_region_create(void)
+{
+	region_t *r;
+
+	if ((r = mm_malloc(sizeof(region_t))) == NULL)
+		return (NULL);
+	r->chunks = r->bump = r->next = r->end = NULL;
+	return (r);
+}
+
+/*
+ * Requires:
+ *   "r" is a region.
+ *
+ * Effects:
+ *   Allocate an object with at least "size" bytes of payload from "r",
+ *   aligned as mm_malloc aligns blocks, unless "size" is zero.  A small
+ *   object takes the next bytes of the bump chunk, which is replaced by a
+ *   new chunk of MM_REGION_CHUNK bytes when it has no room left; an object
+ *   of more than a quarter of that gets a chunk of its own, so that it does
+ *   not waste the rest of the bump chunk.  The object lives until "r" is
+ *   reset or destroyed, and cannot be freed on its own.  Returns the
+ *   address of the object, or NULL if memory ran out.
+ */
+void *
+mm_region_alloc(mm_region_t *r, size_t size)
+{
+	size_t asize;
+	char *cp, *bp;
+
+	/* Ignore spurious requests. */
+	if (size == 0 || size > (size_t)-1 - 2 * DSIZE)
+		return (NULL);
+	asize = DSIZE * ((size + (DSIZE - 1)) / DSIZE);
+
+	if (asize <= (size_t)(r->end - r->next)) {
+		bp = r->next;
+		r->next += asize;
+		return (bp);
+	}
+
+	/* A large object goes in a chunk of its own, after the bump chunk. */
+	if (asize > MM_REGION_CHUNK / 4) {
+		if ((cp = mm_malloc(DSIZE + asize)) == NULL)
+			return (NULL);
+		CHUNK_NEXT(cp) = r->chunks;
+		r->chunks = cp;
+		return (cp + DSIZE);
+	}
+
+	/* Retire the bump chunk and start a new one. */
+	if ((cp = mm_malloc(MM_REGION_CHUNK)) == NULL)
+		return (NULL);
+	if (r->bump != NULL) {
+		CHUNK_NEXT(r->bump) = r->chunks;
+		r->chunks = r->bump;
+	}
+	r->bump = cp;
+	r->next = cp + DSIZE + asize;
+	r->end = cp + MM_REGION_CHUNK;
+	return (cp + DSIZE);
+}
+
+/*
+ * Requires:
+ *   "r" is a region.
+ *
+ * Effects:
+ *   Free every object of "r" at once.  All chunks but the bump chunk go
+ *   back to the heap through mm_free_batch, in batches that it sorts and
+ *   coalesces together, and the bump chunk is kept, empty, for the next
+ *   objects.
+ */
+void
+mm_region_reset(mm_region_t *r)
+{
+	void *batch[64];
+	size_t n = 0;
+	char *cp, *next;
+
+	for (cp = r->chunks; cp != NULL; cp = next) {
+		next = CHUNK_NEXT(cp);
+		batch[n++] = cp;
+		if (n == sizeof(batch) / sizeof(batch[0])) {
+			mm_free_batch(batch, n);
+			n = 0;
+		}
+	}
+	if (n > 0)
+		mm_free_batch(batch, n);
+	r->chunks = NULL;
+	if (r->bump != NULL)
+		r->next = r->bump + DSIZE;
+}
+
+/*
+ * Requires:
+ *   "r" is a region.
+ *
+ * Effects:
+ *   Free every object of "r" and "r" itself, giving all of its chunks
+ *   back to the heap.
+ */
+void
+mm_region_destroy(mm_region_t *r)
+{
+	mm_region_reset(r);
+	mm_free(r->bump);
+	mm_free(r);
+}
+
+/*
+ * The following routines work on the current arena.
+ */
+
+/* 
+ * Requires:
+ *   The region of the current arena has an empty heap.
+ * 
+ * Effects:
+ *   Initialize the current arena.  Returns 0 if the arena was
+ *   successfully initialized and -1 otherwise.
+ *	 The initial heap looks like this: 
+ * 	 ||PADDING|PROLOGUE HEADER (DSIZE/1)|PROLOGUE FOOTER (DSIZE/1)|EPILOGUE (0/PREV_ALLOC_BIT|1)||
+ * 	 Each part is one word.
+ * 	 EPILOGUE signals the end of the heap.
+ * 	 All the segregated free lists start out empty.
+ */
+static int 
+arena_init(void) 
+{
+	int i;
+
+	if (arena == &main_arena)
+		arena->region = mem_default_region();
+
+	/* Create the initial empty heap. */
+	if ((arena->heap_listp = mem_region_sbrk(arena->region, 4 * WSIZE)) == (void *)-1)
+		return (-1);
+	PUT(arena->heap_listp, 0);                            		/* Alignment padding */
+	PUT(arena->heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); 		/* Prologue header */ 
+	PUT(arena->heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); 		/* Prologue footer */ 
+	PUT(arena->heap_listp + (3 * WSIZE), PACK(0, PREV_ALLOC_BIT | 1)); /* Epilogue header */
+	arena->heap_listp += (2 * WSIZE);							/* arena->heap_listp now points to payload of prologue. */
+	arena->top = NULL;
+	for (i = 0; i < NUM_CLASSES; i++)
+		arena->seg_lists[i] = NULL;
+#if MM_TLSF
+	arena->fl_bitmap = 0;
+	for (i = 0; i < FL_COUNT; i++)
+		arena->sl_bitmap[i] = 0;
+#else
+	arena->tree_root = NULL;
+	arena->tree_max = NULL;
+#endif
+	for (i = 0; i < CACHE_BINS; i++) {
+		arena->cache[i] = NULL;
+		arena->cache_count[i] = 0;
+		arena->cache_batch[i] = 1;
+	}
+	memset(&arena->cache_stats, 0, sizeof(arena->cache_stats));
+	memset(&arena->stats, 0, sizeof(arena->stats));
+	arena->blocks = 0;
+#if MM_INSTRUMENT
+	memset(&arena->inst, 0, sizeof(arena->inst));
+	arena->probes = 0;
+#endif
+	arena->grow_step = CHUNKSIZE;
+	arena->since_grow = 0;
+#if MM_THREADS
+	arena->remote_frees = NULL;
+#endif
+
+	/* Extend the empty heap with a free block of CHUNKSIZE bytes. */
+	if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
+		return (-1);
+	return (0);
+}
+
+/* 
+ * Requires:
+ *   size of memory asked by the programmer.
+ *
+ * Effects:
+ *   mm_malloc for the current arena.  Blocks of up to CACHE_MAX bytes come
+ *   from the cache, which is refilled from the heap when its bin is empty.
+ *   Requests of MM_MMAP_THRESHOLD bytes or more get a mapping of their own.
+ *   With MM_THREADS, the blocks that other threads have freed are taken
+ *   back first.
+ */
+static void *
+arena_malloc(size_t size) 
+{
+	size_t asize;      /* Adjusted block size */
+	char *bp;
+	int bin;
+
+	/* Ignore spurious requests. */
+	if (size <= 0)
+		return (NULL);
+
+	if (ARENA_MAPS(size))
+		return (map_alloc(size, DSIZE));
+
+#if MM_THREADS
+	if (__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) != NULL)
+		arena_drain();
+#endif
+
+	/* Adjust block size to include overhead and alignment reqs. */
+	if ((asize = adjust_size(size)) == 0)
+		return (NULL);
+
+	if (MM_CACHE && asize <= CACHE_MAX) {
+		bin = CACHE_BIN(asize);
+		if ((bp = arena->cache[bin]) != NULL) {
+			arena->cache[bin] = CACHE_NEXT(bp);
+			arena->cache_count[bin]--;
+			arena->cache_stats.hits++;
+			return (bp);
+		}
+		arena->cache_stats.misses++;
+		return (cache_fill(asize));
+	}
+	return (block_alloc(asize));
+} 
+
+/* 
+ * Requires:
+ *   "bp" is the address of an allocated block of the current arena.
+ *
+ * Effects:
+ *   Free a block.  Blocks of up to CACHE_MAX bytes go to the cache, which
+ *   gives half of a full bin back to the heap first.  Other blocks are
+ *   coalesced right away.
+ */
+static void
+arena_free(void *bp)
+{
+	size_t size = GET_SIZE(HDRP(bp));
+
+	if (MM_CACHE && size <= CACHE_MAX) {
+		cache_push(bp, CACHE_BIN(size));
+		return;
+	}
+	block_free(bp);
+}
+
+/*
+ * Requires:
+ *   "out" points to an array of at least "n" pointers.
+ *
+ * Effects:
+ *   mm_malloc_batch for the current arena.  Small blocks are taken from
+ *   their bin of the cache first.  All the blocks that are still needed
+ *   are then carved from one block of the heap, so a single find_fit and
+ *   place serve the whole batch; only if no such block can be had are they
+ *   allocated one at a time.  Requests of MM_MMAP_THRESHOLD bytes or more
+ *   get a mapping each.  Returns the number of blocks allocated.
+ */
+static size_t
+arena_malloc_batch(size_t size, size_t n, void **out)
+{
+	size_t asize;      /* Adjusted block size */
+	size_t i = 0;
+	char *bp;
+	int bin;
+
+	/* Ignore spurious requests. */
+	if (size == 0 || n == 0)
+		return (0);
+
+	if (ARENA_MAPS(size)) {
+		for (; i < n; i++)
+			if ((out[i] = map_alloc(size, DSIZE)) == NULL)
+				return (i);
+		return (n);
+	}
+
+#if MM_THREADS
+	if (__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) != NULL)
+		arena_drain();
+#endif
+
+	/* Adjust block size to include overhead and alignment reqs. */
+	if ((asize = adjust_size(size)) == 0)
+		return (0);
+
+	if (MM_CACHE && asize <= CACHE_MAX) {
+		bin = CACHE_BIN(asize);
+		for (; i < n && (bp = arena->cache[bin]) != NULL; i++) {
+			arena->cache[bin] = CACHE_NEXT(bp);
+			arena->cache_count[bin]--;
+			arena->cache_stats.hits++;
+			out[i] = bp;
+		}
+	}
+
+	/* Carve the rest from a single block of the heap. */
+	if (n - i > 1 && n - i <= SIZE_MAX / asize &&
+	    (bp = block_alloc((n - i) * asize)) != NULL) {
+		block_carve(bp, asize, n - i);
+		for (; i < n; i++, bp += asize)
+			out[i] = bp;
+		return (n);
+	}
+	for (; i < n; i++)
+		if ((out[i] = block_alloc(asize)) == NULL)
+			return (i);
+	return (n);
+}
+
+/*
+ * Requires:
+ *   "ptrs" points to an array of "n" pointers, each either the address of
+ *   an allocated block or NULL.
+ *
+ * Effects:
+ *   mm_free_batch for the current arena.  Blocks of up to CACHE_MAX bytes
+ *   go to the cache as they come, as by arena_free, without being sorted.
+ *   The other blocks are moved to the front of the array and sorted by
+ *   address, and every run of them that lie next to each other is merged
+ *   into one block, which is freed and coalesced once.  Blocks with a mapping of their own are unmapped,
+ *   and with MM_THREADS, blocks of other arenas are queued as remote frees.
+ */
+static void
+arena_free_batch(void **ptrs, size_t n)
+{
+	size_t i, m, size;
+	char *bp;
+#if MM_THREADS
+	arena_t *a;
+#endif
+
+	for (i = m = 0; i < n; i++) {
+		if ((bp = ptrs[i]) == NULL)
+			continue;
+#if MM_THREADS
+		if ((a = arena_of(bp)) == NULL) {
+			map_free(bp);
+			continue;
+		}
+		if (a != arena) {
+			arena_remote_free(a, bp);
+			continue;
+		}
+#else
+		if (GET_MAPPED(HDRP(bp))) {
+			map_free(bp);
+			continue;
+		}
+#endif
+		size = GET_SIZE(HDRP(bp));
+		if (MM_CACHE && size <= CACHE_MAX)
+			cache_push(bp, CACHE_BIN(size));
+		else
+			ptrs[m++] = bp;
+	}
+	if (m > 1)
+		qsort(ptrs, m, sizeof(void *), ptr_compare);
+
+	/* Blocks next to each other in memory are in the same region. */
+	for (i = 0; i < m; i++) {
+		bp = ptrs[i];
+		size = GET_SIZE(HDRP(bp));
+		if (i + 1 == m || ptrs[i + 1] != bp + size) {
+			block_free(bp);
+			continue;
+		}
+		for (; i + 1 < m && ptrs[i + 1] == bp + size; i++) {
+			size += GET_SIZE(HDRP(ptrs[i + 1]));
+			arena->stats.coalesces++;
+			arena->blocks--;
+		}
+		PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | 1));
+		block_free(bp);
+	}
+}
+
+/*
+ * Requires:
+ *   "alignment" is a power of two greater than DSIZE.
+ *
+ * Effects:
+ *   mm_memalign for the current arena.  The block comes straight from the
+ *   heap, bypassing the cache: the first free block with room for an
+ *   aligned payload of "size" bytes is used, and any gap before the payload
+ *   is split off as a free block.  If no free block has room, the heap is
+ *   extended by enough for any placement of the payload.  Requests of
+ *   MM_MMAP_THRESHOLD bytes or more get an aligned mapping of their own.
+ *   Returns the address of the block if the allocation was successful and
+ *   NULL otherwise.
+ */
+static void *
+arena_memalign(size_t alignment, size_t size)
+{
+	size_t asize;      /* Adjusted block size */
+	size_t extendsize; /* Amount to extend heap if no fit */
+	void *bp;
+
+	/* Ignore spurious requests. */
+	if (size == 0)
+		return (NULL);
+
+	if (ARENA_MAPS(size))
+		return (map_alloc(size, alignment));
+
+#if MM_THREADS
+	if (__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) != NULL)
+		arena_drain();
+#endif
+
+	if ((asize = adjust_size(size)) == 0)
+		return (NULL);
+	if (asize + alignment + MINBLOCK < asize)
+		return (NULL);
+
+	bp = find_aligned_fit(asize, alignment);
+	COUNT_PROBES();
+	if (bp == NULL) {
+		extendsize = grow_size(asize + alignment + MINBLOCK);
+		if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+			return (NULL);
+	}
+	return (place_aligned(bp, asize, alignment));
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   mm_calloc for the current arena, for a block of "size" bytes.  A block
+ *   with a mapping of its own is zero already.  A block of the heap that is
+ *   placed in a fresh free block only has the words that the free block
+ *   wrote cleared, and any other block is cleared in full.  Small blocks
+ *   come from the cache like any other, so they are always cleared in full.
+ *   Returns the address of the block if the allocation was successful and
+ *   NULL otherwise.
+ */
+static void *
+arena_calloc(size_t size)
+{
+	size_t asize;      /* Adjusted block size */
+	size_t extendsize; /* Amount to extend heap if no fit */
+	size_t bsize;
+	char *bp;
+	bool fresh;
+
+	/* Ignore spurious requests. */
+	if (size == 0)
+		return (NULL);
+
+	/* The pages of a new mapping are zero. */
+	if (ARENA_MAPS(size))
+		return (map_alloc(size, DSIZE));
+
+	if ((asize = adjust_size(size)) == 0)
+		return (NULL);
+	if (MM_CACHE && asize <= CACHE_MAX) {
+		if ((bp = arena_malloc(size)) != NULL)
+			memset(bp, 0, size);
+		return (bp);
+	}
+
+#if MM_THREADS
+	if (__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) != NULL)
+		arena_drain();
+#endif
+
+	/* As block_alloc, but note whether the block was fresh before placing. */
+	arena->since_grow++;
+	bp = find_fit(asize);
+	COUNT_PROBES();
+	if (bp == NULL) {
+		extendsize = grow_size(asize);
+		if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+			return (NULL);
+	}
+	fresh = GET_FRESH(HDRP(bp));
+	place(bp, asize);
+	if (!fresh) {
+		memset(bp, 0, size);
+		return (bp);
+	}
+
+	/* Clear the free-list links and, if the block was not split, the footer. */
+	bsize = GET_SIZE(HDRP(bp));
+	memset(bp, 0, MIN(NODE_SIZE, bsize - WSIZE));
+	PUT(bp + bsize - DSIZE, 0);
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "stats" points to the counters summed over the arenas so far.
+ *
+ * Effects:
+ *   Add the counters of the current arena to "*stats".  The size of the
+ *   largest free block is at hand when it is the top or in the tree.  In
+ *   TLSF mode the bitmaps find the highest non-empty bin, and the least
+ *   size of that bin stands for its largest block, so nothing is walked.
+ *   Otherwise the highest non-empty list is walked, here and only here,
+ *   so that the free paths never have to keep track of it.
+ */
+static void
+arena_stats(mm_stats_t *stats)
+{
+	size_t heapsize, largest = 0;
+#if !MM_TLSF
+	char *bp = NULL;
+#endif
+	int i;
+
+	/* An arena that mm_init has not set up yet has no heap. */
+	if (arena->heap_listp == NULL)
+		return;
+	heapsize = mem_region_heapsize(arena->region);
+	stats->heap_bytes += heapsize;
+	stats->alloc_bytes += heapsize - 4 * WSIZE - arena->stats.free_bytes;
+	stats->alloc_blocks += arena->blocks - arena->stats.free_blocks;
+	stats->free_bytes += arena->stats.free_bytes;
+	stats->free_blocks += arena->stats.free_blocks;
+	for (i = 0; i < MM_STATS_CLASSES; i++)
+		stats->class_blocks[i] += arena->stats.class_blocks[i];
+	stats->splits += arena->stats.splits;
+	stats->coalesces += arena->stats.coalesces;
+	stats->grows += arena->stats.grows;
+	stats->shrinks += arena->stats.shrinks;
+	stats->releases += arena->stats.releases;
+
+	if (arena->top != NULL)
+		largest = GET_SIZE(HDRP(arena->top));
+#if MM_TLSF
+	if (arena->fl_bitmap != 0) {
+		i = FLS(arena->fl_bitmap);
+		largest = MAX(largest, class_min(i * SL_COUNT + FLS(arena->sl_bitmap[i])));
+	}
+#else
+	if (arena->tree_max != NULL)
+		largest = MAX(largest, GET_SIZE(HDRP(arena->tree_max)));
+	else {
+		for (i = NUM_CLASSES - 1; i >= 0 && arena->seg_lists[i] == NULL; i--)
+			;
+		if (i >= 0)
+			bp = arena->seg_lists[i];
+	}
+	for (; bp != NULL; bp = GET_NEXT_PTR(bp))
+		largest = MAX(largest, GET_SIZE(HDRP(bp)));
+#endif
+	stats->largest_free = MAX(stats->largest_free, largest);
+}
+
+/* 
+ * Requires:
+ *   A block size "asize" of at least MINBLOCK bytes.
+ *
+ * Effects:
+ *   Allocate a block of at least "asize" bytes from the heap, extending the
+ *   heap if no free block fits.  Returns the address of this block if the
+ *   allocation was successful and NULL otherwise.
+ */
+static void *
+block_alloc(size_t asize) 
+{
+	size_t extendsize; /* Amount to extend heap if no fit */
+	void *bp;
+
+	/* Search the free list for a fit. */
+	arena->since_grow++;
+	bp = find_fit(asize);
+	COUNT_PROBES();
+	if (bp != NULL) {
+		place(bp, asize);
+		return (bp);
+	}
+
+	/* No fit found.  Get more memory and place the block. */
+	extendsize = grow_size(asize);
+	if ((bp = extend_heap(extendsize / WSIZE)) == NULL)  
+		return (NULL);
+	place(bp, asize);
+	return (bp);
+} 
+
+/* 
+ * Requires:
+ *   "bp" is the address of an allocated block of the current arena that is
+ *   not in the cache.
+ *
+ * Effects:
+ *   Free a block and coalesce.  If that leaves a free block of at least
+ *   MM_RELEASE_THRESHOLD bytes, the pages inside it that may still be
+ *   resident are given back.  Those are the pages of "bp" and of any
+ *   neighbour it merged with that was too small to have given back its
+ *   own; a larger neighbour has done so already.  With MM_INSTRUMENT the
+ *   merge is counted here rather than in coalesce, which also takes the
+ *   remainders of splits and the new space of a grown heap.
+ */
+static void
+block_free(void *bp)
+{
+	size_t size;
+	char *lo, *hi;
+
+	/* Free and coalesce the block. */
+	size = GET_SIZE(HDRP(bp));
+	PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+	PUT(FTRP(bp), PACK(size, 0));
+	CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	lo = HDRP(bp);
+	hi = lo + size;
+	if (!GET_PREV_ALLOC(HDRP(bp)) &&
+	    GET_SIZE(HDRP(PREV_BLKP(bp))) < MM_RELEASE_THRESHOLD)
+		lo = HDRP(PREV_BLKP(bp));
+	if (!GET_ALLOC(HDRP(NEXT_BLKP(bp))) &&
+	    GET_SIZE(HDRP(NEXT_BLKP(bp))) < MM_RELEASE_THRESHOLD)
+		hi += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+	COUNT(coalesce[(GET_PREV_ALLOC(HDRP(bp)) ? 0 : 2) + !GET_ALLOC(HDRP(NEXT_BLKP(bp)))]);
+	bp = coalesce(bp);
+
+	/* Release a large free block at the top of the heap. */
+	if (MM_TRIM_THRESHOLD > 0 && GET_SIZE(HDRP(bp)) > MM_TRIM_THRESHOLD &&
+	    GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)
+		arena_trim(CHUNKSIZE);
+	else if (MM_RELEASE_THRESHOLD > 0 &&
+	    GET_SIZE(HDRP(bp)) >= MM_RELEASE_THRESHOLD)
+		release_pages(bp, lo, hi);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Give every block in the cache back to the heap.
+ */
+static void
+cache_empty(void)
+{
+	char *bp, *next;
+	int bin;
+
+	for (bin = 0; bin < CACHE_BINS; bin++) {
+		for (bp = arena->cache[bin]; bp != NULL; bp = next) {
+			next = CACHE_NEXT(bp);
+			block_free(bp);
+		}
+		arena->cache[bin] = NULL;
+		arena->cache_count[bin] = 0;
+	}
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   If the last block of the heap is free and bigger than "pad" bytes,
+ *   shrink it to "pad" bytes, or to nothing if "pad" is zero, and lower
+ *   the brk by the difference.  Returns 1 if the heap shrank and 0
+ *   otherwise.
+ */
+static int
+arena_trim(size_t pad)
+{
+	char *bp;
+	char *epilogue = (char *)mem_region_hi(arena->region) + 1;
+	size_t size, keep;
+
+	/* A free last block ends right before the epilogue header. */
+	if (GET_PREV_ALLOC(HDRP(epilogue)))
+		return (0);
+	bp = PREV_BLKP(epilogue);
+	size = GET_SIZE(HDRP(bp));
+	keep = (pad == 0) ? 0 : MAX(MINBLOCK, DSIZE * ((pad + (DSIZE - 1)) / DSIZE));
+	if (size <= keep)
+		return (0);
+
+	/* Its previous block is allocated, since free blocks are coalesced. */
+	remove_from_free_list(bp);
+	arena->stats.shrinks++;
+	if (keep == 0) {
+		PUT(HDRP(bp), PACK(0, PREV_ALLOC_BIT | 1));  /* New epilogue header */
+		arena->blocks--;
+	} else {
+		PUT(HDRP(bp), PACK(keep, PREV_ALLOC_BIT | GET_FRESH(HDRP(bp))));
+		PUT(FTRP(bp), PACK(keep, 0));
+		PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));       /* New epilogue header */
+		insert_in_free_list(bp);
+	}
+	mem_region_sbrk(arena->region, -(intptr_t)(size - keep));
+	return (1);
+}
+
+/*
+ * Requires:
+ *   "asize" is the least number of bytes that the heap must grow by.
+ *
+ * Effects:
+ *   Returns how many bytes to grow the heap by for a request that no free
+ *   block fits.  With MM_GROW_FIXED that is at least CHUNKSIZE.  With
+ *   MM_GROW_ADAPTIVE it is at least the step of the arena, which first
+ *   shrinks by half if more than half of the heap is free, since growing
+ *   then only feeds fragmentation, and otherwise doubles if the heap last
+ *   grew no more than GROW_WINDOW allocations ago, since demand is
+ *   sustained.  The step stays between CHUNKSIZE and GROW_MAX.
+ */
+static size_t
+grow_size(size_t asize)
+{
+	size_t heapsize;
+
+	if (growth == MM_GROW_ADAPTIVE) {
+		heapsize = mem_region_heapsize(arena->region);
+		if (arena->stats.free_bytes > heapsize / 2)
+			arena->grow_step = MAX(arena->grow_step / 2, CHUNKSIZE);
+		else if (arena->since_grow <= GROW_WINDOW)
+			arena->grow_step = MIN(arena->grow_step * 2,
+			    MAX(MIN(heapsize / GROW_RATIO, GROW_MAX), CHUNKSIZE));
+		arena->since_grow = 0;
+	}
+	return (MAX(asize, arena->grow_step));
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of an allocated block of the current arena of at
+ *   least the size of "bin".
+ *
+ * Effects:
+ *   Push the block on "bin" of the cache, giving half of the bin back to
+ *   the heap first if it is full, and let the next refill of the bin take
+ *   a bigger batch.
+ */
+static void
+cache_push(void *bp, int bin)
+{
+	if (arena->cache_count[bin] == CACHE_LIMIT)
+		cache_flush(bin);
+	CACHE_NEXT(bp) = arena->cache[bin];
+	arena->cache[bin] = bp;
+	arena->cache_count[bin]++;
+	if (arena->cache_batch[bin] < CACHE_FILL)
+		arena->cache_batch[bin]++;
+	arena->cache_stats.frees++;
+}
+
+/*
+ * Requires:
+ *   A block size "asize" of at most CACHE_MAX bytes whose bin is empty.
+ *
+ * Effects:
+ *   Refill the bin of "asize" with a single trip to the heap: one block big
+ *   enough for the batch of the bin is allocated and cut into that many
+ *   allocated blocks of "asize" bytes.  The last one, which also takes any
+ *   slack that place could not split off, is returned and the others are
+ *   cached.  If the heap cannot supply that much, a single block is
+ *   allocated.  Returns NULL if no block could be allocated.
+ */
+static void *
+cache_fill(size_t asize)
+{
+	char *bp;
+	int bin = CACHE_BIN(asize);
+	int n = arena->cache_batch[bin];
+	int i;
+
+	if (n == 1 || (bp = block_alloc(n * asize)) == NULL)
+		return (block_alloc(asize));
+	block_carve(bp, asize, n);
+
+	/* Push from the top so that the bin hands out the lowest block first. */
+	for (i = n - 2; i >= 0; i--) {
+		CACHE_NEXT(bp + i * asize) = arena->cache[bin];
+		arena->cache[bin] = bp + i * asize;
+	}
+	arena->cache_count[bin] = n - 1;
+	return (bp + (n - 1) * asize);
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of an allocated block of at least "n" * "asize"
+ *   bytes, just placed, and "n" is at least 2.
+ *
+ * Effects:
+ *   Cut the block into "n" allocated blocks of "asize" bytes, the last of
+ *   which also takes any slack that place could not split off.  The next
+ *   block already has its previous-allocated bit.
+ */
+static void
+block_carve(void *bp, size_t asize, size_t n)
+{
+	size_t total = GET_SIZE(HDRP(bp));
+	size_t i;
+
+	arena->stats.splits++;
+	arena->blocks += n - 1;
+	PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+	for (i = 1; i < n - 1; i++)
+		PUT(HDRP((char *)bp + i * asize), PACK(asize, PREV_ALLOC_BIT | 1));
+	PUT(HDRP((char *)bp + (n - 1) * asize),
+	    PACK(total - (n - 1) * asize, PREV_ALLOC_BIT | 1));
+}
+
+/*
+ * Requires:
+ *   "bin" is a bin of the cache that holds CACHE_LIMIT blocks.
+ *
+ * Effects:
+ *   Keep the CACHE_LIMIT / 2 most recently freed blocks of the bin and give
+ *   the older ones back to the heap, where they are coalesced.
+ */
+static void
+cache_flush(int bin)
+{
+	char *bp, *next;
+	int i;
+
+	bp = arena->cache[bin];
+	for (i = 1; i < CACHE_LIMIT / 2; i++)
+		bp = CACHE_NEXT(bp);
+	next = CACHE_NEXT(bp);
+	CACHE_NEXT(bp) = NULL;
+	for (bp = next; bp != NULL; bp = next) {
+		next = CACHE_NEXT(bp);
+		block_free(bp);
+	}
+	arena->cache_count[bin] = CACHE_LIMIT / 2;
+	arena->cache_stats.flushes++;
+}
+
+/*
+ * Requires:
+ *   "ptr" is either the address of an allocated block or NULL.
+ *
+ * Effects:
+ *   Reallocates the block "ptr" to a block with at least "size" bytes of payload, unless "size" is zero.  
+ *	 If "size" is zero, frees the block "ptr" and returns NULL.  
+ * 	 If the block "ptr" is already big enough, it is kept in place, and
+ * 	 whenever its tail would make a block of at least MINBLOCK bytes, as
+ * 	 place splits a free block, that tail is given back to the heap.
+ *   If "size" is more than the size of "ptr" block, the block grows in place
+ * 	 whenever it can, trying in turn:
+ * 	 a. the free block after it, if that is big enough, giving any excess
+ * 	    back to the heap;
+ * 	 b. extending the heap by just the shortfall, if the block, or the free
+ * 	    block after it, is the last block before the epilogue;
+ * 	 c. the free blocks before and after it together, moving the payload
+ * 	    down with memmove.
+ *	 Otherwise a new block is allocated and the payload of the old block "ptr" is copied to that new block.
+ *   A block with a mapping of its own is handled by map_realloc.  A block of
+ *   the heap that grows to MM_MMAP_THRESHOLD bytes or more still grows in
+ *   place when it can, and only moves to a mapping when it cannot.
+ *   Returns the address of the resulting block if the reallocation was
+ *   successful and NULL otherwise, in which case "ptr" is left unchanged.
+ */
+static void * 
+arena_realloc(void * bp, size_t size)
+{
+	size_t oldsize;   /* Size of the block "bp" */
+	size_t asize;     /* Valid requested block size */
+	size_t csize;     /* Size of the combined blocks */
+	size_t nsize = 0; /* Size of the next block, if it is free */
+	char *next, *prevp, *newp;
+
+	if ((int)size < 0) 
+		return (NULL); 
+
+	if (bp != NULL && GET_MAPPED(HDRP(bp)))
+		return (map_realloc(bp, size));
+
+	if (size == 0) { 
+		if (bp != NULL)
+			arena_free(bp); 
+		return (NULL); 
+	} 
+
+	/* If bp is NULL, then this is just malloc. */
+	if (bp == NULL)
+		return (arena_malloc(size));
+
+	oldsize = GET_SIZE(HDRP(bp)); 
+	if ((asize = adjust_size(size)) == 0)
+		return (NULL);
+
+	/* Shrinking, or growing within the slack of the block. */
+	if (asize <= oldsize) { 
+		COUNT(realloc_inplace);
+		trim_block(bp, asize);
+		return (bp); 
+	}
+
+	next = NEXT_BLKP(bp);
+	if (!GET_ALLOC(HDRP(next)))
+		nsize = GET_SIZE(HDRP(next));
+
+	/*
+	 * If the block is last, extend the heap by just the shortfall.  The new
+	 * free block coalesces with the free block after "bp", if there is one.
+	 */
+	if (oldsize + nsize < asize && GET_SIZE(HDRP(nsize > 0 ? NEXT_BLKP(next) : next)) == 0) {
+		if (extend_heap(MAX(asize - oldsize - nsize, MINBLOCK) / WSIZE) == NULL)
+			return (NULL);
+		nsize = GET_SIZE(HDRP(next));
+	}
+
+	/* Absorb the free block after bp. */
+	if (oldsize + nsize >= asize) {
+		COUNT(realloc_inplace);
+		remove_from_free_list(next);
+		arena->stats.coalesces++;
+		arena->blocks--;
+		PUT(HDRP(bp), PACK(oldsize + nsize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+		trim_block(bp, asize);
+		return (bp);
+	}
+
+	/* Absorb the free blocks on both sides and move the payload down. */
+	if (!GET_PREV_ALLOC(HDRP(bp))) {
+		prevp = PREV_BLKP(bp);
+		csize = GET_SIZE(HDRP(prevp)) + oldsize + nsize;
+		if (csize >= asize) {
+			COUNT(realloc_slid);
+			remove_from_free_list(prevp);
+			arena->stats.coalesces++;
+			arena->blocks--;
+			if (nsize > 0) {
+				remove_from_free_list(next);
+				arena->stats.coalesces++;
+				arena->blocks--;
+			}
+			PUT(HDRP(prevp), PACK(csize, PREV_ALLOC_BIT | 1));
+			memmove(prevp, bp, oldsize - WSIZE);
+			trim_block(prevp, asize);
+			return (prevp);
+		}
+	}
+
+	/* If it couldn't fit, create a new block and copy the payload. */
+	if ((newp = arena_malloc(size)) == NULL)
+		return (NULL);
+	COUNT(realloc_copied);
+	memcpy(newp, bp, oldsize - WSIZE); 
+	/* A block that has outgrown its size is not worth caching. */
+	block_free(bp); 
+	return (newp); 
+} 
+
+/*
+ * Requires:
+ *   "bp" is the address of an allocated block of at least "asize" bytes,
+ *   which may have just absorbed the free block after it.
+ *
+ * Effects:
+ *   Shrink the block to "asize" bytes if the tail would be at least
+ *   MINBLOCK bytes, and give the tail back to the heap, where it is
+ *   coalesced.  Otherwise keep the whole block and mark it allocated in
+ *   the header of the next block.
+ */
+static void
+trim_block(void *bp, size_t asize)
+{
+	size_t csize = GET_SIZE(HDRP(bp));
+	char *tail;
+
+	if (csize - asize >= MINBLOCK) {
+		arena->stats.splits++;
+		arena->blocks++;
+		PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+		tail = NEXT_BLKP(bp);
+		PUT(HDRP(tail), PACK(csize - asize, PREV_ALLOC_BIT | 1));
+		block_free(tail);
+	} else
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+}
+
+/*
+ * Requires:
+ *   "bp" is a free block of the current arena, and "lo" and "hi" bound a
+ *   part of it.
+ *
+ * Effects:
+ *   Give the whole pages between "lo" and "hi" back to memlib, except any
+ *   that hold the header, list or tree links, or footer of "bp".  The
+ *   pages read as zero afterwards and fault in again only when a block
+ *   placed in "bp" writes to them.
+ */
+static void
+release_pages(void *bp, char *lo, char *hi)
+{
+	uintptr_t pagesize = mem_pagesize();
+	uintptr_t start = (uintptr_t)MAX(lo, (char *)bp + NODE_SIZE);
+	uintptr_t end = (uintptr_t)MIN(hi, FTRP(bp));
+
+	start = (start + pagesize - 1) & ~(pagesize - 1);
+	end &= ~(pagesize - 1);
+	if (start < end) {
+		mem_release((void *)start, end - start);
+		arena->stats.releases++;
+	}
+}
+
+/*
+ * The following routines manage blocks with mappings of their own.
+ */
+
+/*
+ * Requires:
+ *   A request of "size" bytes, which is at least MM_MMAP_THRESHOLD, and an
+ *   "alignment" that is a power of two no smaller than DSIZE.
+ *
+ * Effects:
+ *   Allocate a block with at least "size" bytes of payload, aligned to
+ *   "alignment" bytes, in a mapping of its own.  The mapping is rounded up
+ *   to whole pages.  The header and the offset of the payload from the
+ *   start of the mapping take the double word before the payload, which is
+ *   the first double word of the mapping unless a larger alignment needs
+ *   more room.  Returns the address of the block, or NULL if no mapping
+ *   could be made.
+ */
+static void *
+map_alloc(size_t size, size_t alignment)
+{
+	size_t pagesize = mem_pagesize();
+	size_t extra, len;
+	char *p, *bp;
+
+	/* Mappings start on a page, so only bigger alignments cost extra room. */
+	extra = (alignment <= pagesize) ? alignment : alignment + DSIZE;
+	len = pagesize * ((size + extra + (pagesize - 1)) / pagesize);
+	if (len < size || (tag_t)len != len || (p = mem_map(len)) == NULL)
+		return (NULL);
+	bp = (char *)(((uintptr_t)p + DSIZE + (alignment - 1)) & ~(uintptr_t)(alignment - 1));
+	MAP_OFFSET(bp) = bp - p;
+	PUT(HDRP(bp), PACK(len, MAPPED_BIT | PREV_ALLOC_BIT | 1));
+	__atomic_add_fetch(&mapped_bytes, len, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&mapped_blocks, 1, __ATOMIC_RELAXED);
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of a block with a mapping of its own.
+ *
+ * Effects:
+ *   Unmap the block, giving its pages straight back to the system.
+ */
+static void
+map_free(void *bp)
+{
+	__atomic_sub_fetch(&mapped_bytes, GET_SIZE(HDRP(bp)), __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&mapped_blocks, 1, __ATOMIC_RELAXED);
+	mem_unmap((char *)bp - MAP_OFFSET(bp), GET_SIZE(HDRP(bp)));
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of a block with a mapping of its own.
+ *
+ * Effects:
+ *   Reallocate the block to at least "size" bytes of payload, or free it
+ *   and return NULL if "size" is zero.  Below
+ *   MM_MMAP_THRESHOLD the payload is copied to a block of the current
+ *   arena.  Otherwise the mapping is resized with mem_remap, which keeps
+ *   the pages, moving them if it has to, without copying them.  A payload
+ *   that was aligned beyond a page may lose that alignment if the mapping
+ *   moves.  Returns the address of the resulting block, or NULL, leaving
+ *   "bp" unchanged, if the reallocation failed.
+ */
+static void *
+map_realloc(void *bp, size_t size)
+{
+	size_t pagesize = mem_pagesize();
+	size_t offset = MAP_OFFSET(bp);
+	size_t oldlen = GET_SIZE(HDRP(bp));
+	size_t len = pagesize * ((size + offset + (pagesize - 1)) / pagesize);
+	char *p;
+
+	if (size == 0) {
+		map_free(bp);
+		return (NULL);
+	}
+	if (!IS_MAPPED_SIZE(size)) {
+		if ((p = arena_malloc(size)) == NULL)
+			return (NULL);
+		memcpy(p, bp, size);
+		map_free(bp);
+		return (p);
+	}
+	if (len == oldlen)
+		return (bp);
+	if (len < size || (tag_t)len != len ||
+	    (p = mem_remap((char *)bp - offset, oldlen, len)) == NULL)
+		return (NULL);
+	PUT(p + offset - WSIZE, PACK(len, MAPPED_BIT | PREV_ALLOC_BIT | 1));
+	__atomic_add_fetch(&mapped_bytes, len - oldlen, __ATOMIC_RELAXED);
+	return (p + offset);
+}
+
+#if MM_THREADS
+/*
+ * The following routines bind threads to arenas.
+ */
+
+/*
+ * Requires:
+ *   The calling thread is not bound to an arena.
+ *
+ * Effects:
+ *   Bind the calling thread to an arena that no running thread owns,
+ *   creating and initializing a new arena if there is none.  This is the
+ *   only path that takes arenas_lock.  Returns the arena, or NULL if a new
+ *   one was needed and could not be created.
+ */
+static arena_t *
+arena_bind(void)
+{
+	arena_t *a;
+	arena_t *saved = arena;
+
+	pthread_once(&arena_key_once, arena_make_key);
+	pthread_mutex_lock(&arenas_lock);
+	for (a = arenas; a != NULL && a->owned; a = a->next)
+		;
+	if (a == NULL) {
+		if ((a = calloc(1, sizeof(arena_t))) == NULL) {
+			pthread_mutex_unlock(&arenas_lock);
+			return (NULL);
+		}
+		if ((a->region = mem_region_create()) == NULL) {
+			free(a);
+			pthread_mutex_unlock(&arenas_lock);
+			return (NULL);
+		}
+		arena = a;
+		if (arena_init() < 0) {
+			arena = saved;
+			mem_region_destroy(a->region);
+			free(a);
+			pthread_mutex_unlock(&arenas_lock);
+			return (NULL);
+		}
+		arena = saved;
+
+		/* Publish the arena only once it is complete; see arena_of. */
+		a->next = arenas;
+		__atomic_store_n(&arenas, a, __ATOMIC_RELEASE);
+	}
+	a->owned = true;
+	pthread_mutex_unlock(&arenas_lock);
+
+	pthread_setspecific(arena_key, a);
+	thread_arena = a;
+	return (a);
+}
+
+/*
+ * Requires:
+ *   "a" is the arena of a thread that is exiting.
+ *
+ * Effects:
+ *   Make "a", with the blocks that are still allocated from it, available
+ *   to the next thread that binds to an arena.
+ */
+static void
+arena_release(void *a)
+{
+	pthread_mutex_lock(&arenas_lock);
+	((arena_t *)a)->owned = false;
+	pthread_mutex_unlock(&arenas_lock);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Create the key whose destructor releases the arena of an exiting thread.
+ */
+static void
+arena_make_key(void)
+{
+	pthread_key_create(&arena_key, arena_release);
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of an allocated block.
+ *
+ * Effects:
+ *   Returns the arena whose region holds "bp", or NULL if "bp" has a
+ *   mapping of its own.  The thread's own arena is tried first.  The list of arenas is read without arenas_lock, which is
+ *   safe because arenas are only ever added at its head, fully initialized.
+ */
+static arena_t *
+arena_of(void *bp)
+{
+	arena_t *a = thread_arena;
+
+	if (a != NULL && mem_region_contains(a->region, bp))
+		return (a);
+	for (a = __atomic_load_n(&arenas, __ATOMIC_ACQUIRE); a != NULL;
+	    a = a->next) {
+		if (mem_region_contains(a->region, bp))
+			return (a);
+	}
+	return (NULL);
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of an allocated block of the arena "a", which is
+ *   not the arena of the calling thread.
+ *
+ * Effects:
+ *   Push "bp" on the queue of remote frees of "a".  Any number of threads
+ *   may push at once without a lock; only the thread that drains the queue
+ *   takes blocks off it, all at once, so the push cannot suffer from ABA.
+ */
+static void
+arena_remote_free(arena_t *a, void *bp)
+{
+	char *head = __atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED);
+
+	do {
+		REMOTE_NEXT(bp) = head;
+	} while (!__atomic_compare_exchange_n(&a->remote_frees, &head, bp, true,
+	    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * Requires:
+ *   The current arena was entered with arena_enter.
+ *
+ * Effects:
+ *   Take the whole queue of remote frees of the current arena at once and
+ *   free its blocks here, on the thread that holds the arena, which is
+ *   normally its owner.  Small blocks go to the cache; the others are
+ *   coalesced.
+ */
+static void
+arena_drain(void)
+{
+	char *bp, *next;
+
+	bp = __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+	for (; bp != NULL; bp = next) {
+		next = REMOTE_NEXT(bp);
+		arena_free(bp);
+	}
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Make the arena of the calling thread the current arena, binding the
+ *   thread to an arena first if it has none.  No lock is taken: only the
+ *   owner works on its arena, and other threads hand it blocks through
+ *   the queue of remote frees.  Returns false if the thread has no arena
+ *   and none could be bound.
+ */
+static bool
+arena_own(void)
+{
+	if (thread_arena == NULL && arena_bind() == NULL)
+		return (false);
+	arena = thread_arena;
+	return (true);
+}
+
+/*
+ * Requires:
+ *   "a" is a heap made by mm_heap_create.
+ *
+ * Effects:
+ *   Lock the heap and make it the current arena.  A heap has no owner, so
+ *   any thread may use it, one at a time.
+ */
+static void
+arena_enter(arena_t *a)
+{
+	pthread_mutex_lock(&a->lock);
+	arena = a;
+}
+
+/*
+ * Requires:
+ *   The current arena was entered with arena_enter.
+ *
+ * Effects:
+ *   Unlock the current arena.
+ */
+static void
+arena_leave(void)
+{
+	pthread_mutex_unlock(&arena->lock);
+	arena = NULL;
+}
+#endif
 
 /*
  * The following routines are internal helper routines.
@@ -275,6 +2525,8 @@ else
  *
  * Effects:
  *   Perform boundary tag coalescing. Updates free list accordingly. 
+ *	 Since free blocks are never adjacent, a merged block always follows an
+ *	 allocated block and gets the previous-allocated bit.
  *	 It removes all the original free blocks under consideration, merges them when applicable,
  *	 and inserts the newly created free block into the list.
  *	 Returns the address of the coalesced block.
@@ -283,7 +2535,7 @@ static void *
 coalesce(void * bp)
 {
   	bool NEXT_ALLOC = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-  	bool PREV_ALLOC = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+  	bool PREV_ALLOC = GET_PREV_ALLOC(HDRP(bp));
  	size_t size = GET_SIZE(HDRP(bp));
   
  	/* If no adjacent blocks are free, add the block to free list and return the pointer. */
@@ -294,28 +2546,34 @@ coalesce(void * bp)
  	
  	/* Only the next block is free. */   
   	else if (PREV_ALLOC && !NEXT_ALLOC) {                  
+    	arena->stats.coalesces++;
+    	arena->blocks--;
     	size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
     	remove_from_free_list(NEXT_BLKP(bp));
-    	PUT(HDRP(bp), PACK(size, 0));
+    	PUT(HDRP(bp), PACK(size, PREV_ALLOC_BIT));
     	PUT(FTRP(bp), PACK(size, 0));
   	}
   
   	/* Only the previous block is free. */  
   	else if (!PREV_ALLOC && NEXT_ALLOC) {               
+    	arena->stats.coalesces++;
+    	arena->blocks--;
     	size += GET_SIZE(HDRP(PREV_BLKP(bp)));
     	bp = PREV_BLKP(bp);
     	remove_from_free_list(bp);
-    	PUT(HDRP(bp), PACK(size, 0));
+    	PUT(HDRP(bp), PACK(size, PREV_ALLOC_BIT));
     	PUT(FTRP(bp), PACK(size, 0));
   	}
   
   	/* Both adjacent blocks are free. */ 
   	else if (!PREV_ALLOC && !NEXT_ALLOC) {                
+    	arena->stats.coalesces += 2;
+    	arena->blocks -= 2;
     	size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
     	remove_from_free_list(PREV_BLKP(bp));
     	remove_from_free_list(NEXT_BLKP(bp));
     	bp = PREV_BLKP(bp);
-    	PUT(HDRP(bp), PACK(size, 0));
+    	PUT(HDRP(bp), PACK(size, PREV_ALLOC_BIT));
     	PUT(FTRP(bp), PACK(size, 0));
   	}
 
@@ -329,27 +2587,52 @@ coalesce(void * bp)
  *   The number of words by which the heap is to be extended.
  *
  * Effects:
- *   Extend the heap with a free block and return that block's address.
+ *   Extend the heap with a free block and return that block's address.  The
+ *   block is fresh if memlib has never handed out its memory before, and it
+ *   stays fresh when it is coalesced with a fresh free block before it.
  */
 static void * 
 extend_heap(size_t words) 
 {
-	void *bp;
+	void *bp, *cp;
 	size_t size;
+	bool fresh, prev_fresh;
 
 	/* Allocate an even number of words to maintain alignment. */
 	size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-	
-	if ((bp = mem_sbrk(size)) == (void *)-1)  
+
+	/* No heap may outgrow a tag, however large its region is, nor grow by more than sbrk takes. */
+	if (size > INTPTR_MAX || (tag_t)(mem_region_heapsize(arena->region) + size) !=
+	    mem_region_heapsize(arena->region) + size)
+		return (NULL);
+
+	fresh = (char *)mem_region_hi(arena->region) + 1 >=
+	    (char *)mem_region_fresh_lo(arena->region);
+	if ((bp = mem_region_sbrk(arena->region, size)) == (void *)-1)  
 		return (NULL);
+	arena->stats.grows++;
+	arena->blocks++;
 
-	/* Initialize free block header/footer and the epilogue header. */
-	PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
+	/* 
+	 * Initialize free block header/footer and the epilogue header.  The new
+	 * block takes over the old epilogue header and its previous-allocated bit.
+	 */
+	PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); /* Free block header */
 	PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
 	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
 
 	/* Coalesce if the previous block was free. */
-	return (coalesce(bp));
+	prev_fresh = !GET_PREV_ALLOC(HDRP(bp)) && GET_FRESH(HDRP(PREV_BLKP(bp)));
+	if ((cp = coalesce(bp)) != bp && fresh && prev_fresh) {
+		/* Clear the old footer and our header, unless they hold links now. */
+		if ((char *)bp - DSIZE >= (char *)cp + NODE_SIZE)
+			PUT((char *)bp - DSIZE, 0);
+		if (HDRP(bp) >= (char *)cp + NODE_SIZE)
+			PUT(HDRP(bp), 0);
+		SET_FRESH(HDRP(cp));
+	} else if (cp == bp && fresh)
+		SET_FRESH(HDRP(cp));
+	return (cp);
 }
 
 /*
@@ -357,22 +2640,104 @@ extend_heap(size_t words)
  *   Size of the block to be found.
  *
  * Effects:
- *   Find a fit for a block with "asize" bytes from the free list. 
+ *   Find a fit for a block with "asize" bytes from the segregated free lists.
+ *   The search starts at the class of "asize", where blocks may still be too
+ *   small, so that class is searched first fit.  Any block in a larger class
+ *   fits, so the head of the first non-empty larger class is taken.
+ * 	 Returns that block's address or NULL if no suitable block was found. 
+ */
+#if MM_TLSF
+/*
+ * Requires:
+ *   Size of the block to be found.
+ *
+ * Effects:
+ *   Find a fit for a block with "asize" bytes from the TLSF index in
+ *   constant time.  If the head of the bin of "asize" is big enough it is
+ *   used.  Otherwise "asize" is rounded up to the next bin boundary, so that
+ *   every block of the first non-empty bin at or above it fits, and the
+ *   bitmaps locate that bin with count-trailing-zeros.  The top of the heap
+ *   is used only if no bin has a fit.
  * 	 Returns that block's address or NULL if no suitable block was found. 
  */
 static void *
 find_fit(size_t asize)
 {
 	void * bp;
+	int class = size_class(asize);
+	int fl, sl;
+	uint32_t map;
 
-	/* Search for the first fit in the free list. */
-	for (bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = GET_NEXT_PTR(bp)){
+	if ((bp = arena->seg_lists[class]) != NULL) {
+		PROBE();
 		if (asize <= GET_SIZE(HDRP(bp)))
 			return (bp);
 	}
-	/* No fit was found. */
-	return (NULL);
+
+	/* Round up to the next bin so that any block found fits. */
+	if (asize >= SMALL_BLOCK)
+		asize += ((size_t)1 << (FLS(asize) - SL_LOG2)) - 1;
+	class = size_class(asize);
+	fl = class / SL_COUNT;
+	sl = class % SL_COUNT;
+
+	/* First look for a non-empty bin in the same range... */
+	map = arena->sl_bitmap[fl] & (~0U << sl);
+	if (map == 0) {
+		/* ...then in the next non-empty range, and at last in the top. */
+		map = (fl + 1 < FL_COUNT) ? arena->fl_bitmap & (~0U << (fl + 1)) : 0;
+		if (map == 0)
+			return (TOP_FIT(asize));
+		fl = __builtin_ctz(map);
+		map = arena->sl_bitmap[fl];
+	}
+	sl = __builtin_ctz(map);
+	PROBE();
+	return (arena->seg_lists[fl * SL_COUNT + sl]);
+}
+#else
+/*
+ * Requires:
+ *   Size of the block to be found.
+ *
+ * Effects:
+ *   Find a fit for a block with "asize" bytes.  Requests up to TREE_MIN
+ *   bytes search the segregated lists starting at the class of "asize",
+ *   where blocks may still be too small, so that class is searched first
+ *   fit.  Any block in a larger class is big enough, so the head of the
+ *   first non-empty larger class is taken.  Larger requests, and small ones
+ *   that no list can satisfy, take the best fit from the tree.  The top of
+ *   the heap is used only if no other free block fits.
+ * 	 Returns that block's address or NULL if no suitable block was found. 
+ */
+static void *
+find_fit(size_t asize)
+{
+	void * bp;
+	int class;
+
+	if (asize <= TREE_MIN) {
+		/* Search for the first fit in the class of asize. */
+		class = size_class(asize);
+		for (bp = arena->seg_lists[class]; bp != NULL; bp = GET_NEXT_PTR(bp)){
+			PROBE();
+			if (asize <= GET_SIZE(HDRP(bp)))
+				return (bp);
+		}
+
+		/* Every block in a larger class is big enough. */
+		for (class++; class < NUM_CLASSES; class++) {
+			if (arena->seg_lists[class] != NULL) {
+				PROBE();
+				return (arena->seg_lists[class]);
+			}
+		}
+	}
+	if ((bp = tree_best_fit(asize)) != NULL)
+		return (bp);
+	return (TOP_FIT(asize));
 }
+#endif
 
 /* 
  * Requires:
@@ -381,93 +2746,625 @@ find_fit(size_t asize)
  * Effects:
  *   Place a block of "asize" bytes at the start of the free block "bp" and
  *   split that block if the remainder would be at least the minimum block
- *   size. It removes the original free block from the list and adds the newly created
+ *   size.  A remainder of the top stays the top without touching any list. It removes the original free block from the list and adds the newly created
  *	 free block, and coalesces the newly formed free block, if formed.
  */
 static void 
 place(void * bp, size_t asize){
   
   size_t csize = GET_SIZE(HDRP(bp));
+  size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  size_t fresh = GET_FRESH(HDRP(bp));
+
+  /* Cut the block off the front of the top, which is in no list, by moving its header up. */
+  if (bp == arena->top && (csize - asize) >= MINBLOCK) {
+    arena->stats.free_bytes -= asize;
+    arena->stats.class_blocks[STATS_CLASS(csize)]--;
+    arena->stats.class_blocks[STATS_CLASS(csize - asize)]++;
+    COUNT(place_split);
+    arena->stats.splits++;
+    arena->blocks++;
+    PUT(HDRP(bp), PACK(asize, prev_alloc | 1));
+    bp = arena->top = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC_BIT | fresh));
+    PUT(FTRP(bp), PACK(csize-asize, 0));
+    return;
+  }
 
-  /* If the next block would be a valid block, split. */
-  if ((csize - asize) >= 4 * WSIZE) {
-    PUT(HDRP(bp), PACK(asize, 1));
-    PUT(FTRP(bp), PACK(asize, 1));
-    remove_from_free_list(bp);
+  /* The block must leave its list while the header still holds its old size. */
+  remove_from_free_list(bp);
+
+  /* If the next block would be a valid block, split.  Old links reach at most NODE_SIZE bytes into the remainder, so it stays fresh. */
+  if ((csize - asize) >= MINBLOCK) {
+    COUNT(place_split);
+    arena->stats.splits++;
+    arena->blocks++;
+    PUT(HDRP(bp), PACK(asize, prev_alloc | 1));
     bp = NEXT_BLKP(bp);
-    PUT(HDRP(bp), PACK(csize-asize, 0));
+    PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC_BIT | fresh));
     PUT(FTRP(bp), PACK(csize-asize, 0));
     coalesce(bp);
   }
   /* If the remaining space was too less to form a block, simply place block. */
   else {
-    PUT(HDRP(bp), PACK(csize, 1));
-    PUT(FTRP(bp), PACK(csize, 1));
-    remove_from_free_list(bp);
+    COUNT(place_whole);
+    PUT(HDRP(bp), PACK(csize, prev_alloc | 1));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
   }
 }
 
+/*
+ * Requires:
+ *   A block size "asize" and an "alignment" that is a power of two greater
+ *   than DSIZE.
+ *
+ * Effects:
+ *   Find a free block with room for a block of "asize" bytes whose payload
+ *   is aligned to "alignment" bytes.  A block of at least "asize" bytes but
+ *   smaller than asize + alignment + MINBLOCK may or may not have room,
+ *   depending on its address, so the lists holding such blocks are searched
+ *   first fit.  Every bigger block has room, so otherwise find_fit is asked
+ *   for one of those.  Blocks in the tree are only found that way.
+ *   Returns that block's address or NULL if no suitable block was found.
+ */
+static void *
+find_aligned_fit(size_t asize, size_t alignment)
+{
+	size_t worst = asize + alignment + MINBLOCK;
+	void *bp;
+	int class, last;
+
+#if MM_TLSF
+	last = size_class(worst);
+#else
+	last = (asize <= TREE_MIN) ? size_class(worst) : -1;
+#endif
+	for (class = size_class(asize); class <= last; class++) {
+		for (bp = arena->seg_lists[class]; bp != NULL; bp = GET_NEXT_PTR(bp)) {
+			PROBE();
+			if (aligned_gap(bp, alignment) + asize <= GET_SIZE(HDRP(bp)))
+				return (bp);
+		}
+	}
+	return (find_fit(worst));
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of a free block with room for a block of "asize"
+ *   bytes whose payload is aligned to "alignment" bytes.
+ *
+ * Effects:
+ *   Place a block of "asize" bytes at the first aligned payload address in
+ *   "bp" that leaves either no gap or a gap of at least MINBLOCK bytes in
+ *   front of it.  The gap becomes a free block of its own, which cannot be
+ *   coalesced since the block before "bp" is allocated, and the rest is
+ *   placed and split as by place.  Returns the address of the new block.
+ */
+static void *
+place_aligned(void *bp, size_t asize, size_t alignment)
+{
+	size_t csize = GET_SIZE(HDRP(bp));
+	size_t gap = aligned_gap(bp, alignment);
+	char *ap;
+
+	if (gap == 0) {
+		place(bp, asize);
+		return (bp);
+	}
+
+	/*
+	 * Split off the gap while the header still holds the old size.  Both
+	 * headers are written before either block is inserted, so that only
+	 * the block at ap can be taken for the top.
+	 */
+	remove_from_free_list(bp);
+	arena->stats.splits++;
+	arena->blocks++;
+	PUT(HDRP(bp), PACK(gap, GET_PREV_ALLOC(HDRP(bp))));
+	PUT(FTRP(bp), PACK(gap, 0));
+	ap = (char *)bp + gap;
+	PUT(HDRP(ap), PACK(csize - gap, 0));
+	PUT(FTRP(ap), PACK(csize - gap, 0));
+	insert_in_free_list(bp);
+	insert_in_free_list(ap);
+	place(ap, asize);
+	return (ap);
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of a block and "alignment" is a power of two
+ *   greater than DSIZE.
+ *
+ * Effects:
+ *   Returns the distance from "bp" to the first payload address in it that
+ *   is aligned to "alignment" bytes and leaves room for a free block before
+ *   it, that is, a gap of zero or of at least MINBLOCK bytes.
+ */
+static size_t
+aligned_gap(void *bp, size_t alignment)
+{
+	size_t gap = (alignment - ((uintptr_t)bp & (alignment - 1))) & (alignment - 1);
+
+	if (gap != 0 && gap < MINBLOCK)
+		gap += alignment;
+	return (gap);
+}
+
 /* 
  * Requires:
  * 	The address "bp" of the block to be inserted.
  * 
  * Effects:
- * 	Inserts the free block pointer from the free list in the LIFO manner.
- * 	The new block will be added to the beginning of the list.
- *  The last element of the free list will be the previous pointer of the prologue.
+ * 	Inserts the free block into the list of its size class in the LIFO manner.
+ * 	The new block will be added to the beginning of the list.  Blocks larger
+ * 	than TREE_MIN are inserted into the tree instead, and the block before
+ * 	the epilogue becomes the top of the heap, so the header of the block
+ * 	after "bp" must be in place.  Either way the block is counted as free
+ * 	in the stats of the arena.
  */
 static void
 insert_in_free_list(void * bp){
+	int class;
+
+	arena->stats.free_bytes += GET_SIZE(HDRP(bp));
+	arena->stats.free_blocks++;
+	arena->stats.class_blocks[STATS_CLASS(GET_SIZE(HDRP(bp)))]++;
+
+	/* The last block of the heap is the top instead. */
+	if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0) {
+		arena->top = bp;
+		return;
+	}
+#if !MM_TLSF
+	/* Large blocks are kept in the tree instead. */
+	if (GET_SIZE(HDRP(bp)) > TREE_MIN) {
+		tree_insert(bp);
+		return;
+	}
+#endif
+	class = size_class(GET_SIZE(HDRP(bp)));
+
 	/* Updating the pointers. */
-  	SET_NEXT_PTR(bp, free_listp); 
-  	SET_PREV_PTR(free_listp, bp); 
+  	SET_NEXT_PTR(bp, arena->seg_lists[class]); 
+  	if (arena->seg_lists[class] != NULL)
+  		SET_PREV_PTR(arena->seg_lists[class], bp); 
   	SET_PREV_PTR(bp, NULL); 
-  	free_listp = bp; 						// Shifting the list pointer to new first block
+  	arena->seg_lists[class] = bp; 					// Shifting the list pointer to new first block
+#if MM_TLSF
+	arena->fl_bitmap |= 1U << (class / SL_COUNT);
+	arena->sl_bitmap[class / SL_COUNT] |= 1U << (class % SL_COUNT);
+#endif
 }
 
 /* 
  * Requires:
- * 	The address "bp" of the block to be removed.
+ * 	The address "bp" of the block to be removed.  Its header must still hold
+ * 	the size it had when it was inserted.
  * 
  * Effects:
- * 	Removes a block from the free list.
+ * 	Removes a block from the list of its size class, or from the tree, or
+ * 	stops it being the top of the heap.
  */
 static void
 remove_from_free_list(void * bp){
+	int class;
+
+	arena->stats.free_bytes -= GET_SIZE(HDRP(bp));
+	arena->stats.free_blocks--;
+	arena->stats.class_blocks[STATS_CLASS(GET_SIZE(HDRP(bp)))]--;
+
+	if (bp == arena->top) {
+		arena->top = NULL;
+		return;
+	}
+#if !MM_TLSF
+	if (GET_SIZE(HDRP(bp)) > TREE_MIN) {
+		tree_remove(bp);
+		return;
+	}
+#endif
   	if (GET_PREV_PTR(bp))
     	SET_NEXT_PTR(GET_PREV_PTR(bp), GET_NEXT_PTR(bp));
     /* If removing the first block, update list pointer. */
-  	else
-    	free_listp = GET_NEXT_PTR(bp);
-  	SET_PREV_PTR(GET_NEXT_PTR(bp), GET_PREV_PTR(bp));
+  	else {
+  		class = size_class(GET_SIZE(HDRP(bp)));
+    	arena->seg_lists[class] = GET_NEXT_PTR(bp);
+#if MM_TLSF
+		/* Clear the bitmap bits of a bin that just became empty. */
+		if (arena->seg_lists[class] == NULL) {
+			arena->sl_bitmap[class / SL_COUNT] &= ~(1U << (class % SL_COUNT));
+			if (arena->sl_bitmap[class / SL_COUNT] == 0)
+				arena->fl_bitmap &= ~(1U << (class / SL_COUNT));
+		}
+#endif
+  	}
+  	if (GET_NEXT_PTR(bp))
+  		SET_PREV_PTR(GET_NEXT_PTR(bp), GET_PREV_PTR(bp));
+}
+
+/* 
+ * Requires:
+ * 	A block size "asize" of at least MINBLOCK bytes.
+ * 
+ * Effects:
+ * 	Returns the index of the segregated list that holds blocks of "asize"
+ * 	bytes.  Class "i" holds sizes up to MINBLOCK << i.  In TLSF mode the
+ * 	index is (first level * SL_COUNT + second level).
+ */
+#if MM_TLSF
+static int
+size_class(size_t asize){
+	int fl, sl;
+
+	/* Small sizes are spread linearly over the bins of range 0. */
+	if (asize < SMALL_BLOCK)
+		return ((int)(asize / (SMALL_BLOCK / SL_COUNT)));
+
+	fl = FLS(asize) - FL_SHIFT + 1;
+	sl = (int)(asize >> (FLS(asize) - SL_LOG2)) ^ SL_COUNT;
+	if (fl >= FL_COUNT)
+		return (NUM_CLASSES - 1);
+	return (fl * SL_COUNT + sl);
+}
+
+/* 
+ * Requires:
+ * 	A TLSF bin "class".
+ * 
+ * Effects:
+ * 	Returns the smallest block size that size_class puts in bin "class".
+ */
+static size_t
+class_min(int class){
+	size_t base;
+
+	if (class < SL_COUNT)
+		return ((size_t)class * (SMALL_BLOCK / SL_COUNT));
+	base = SMALL_BLOCK << (class / SL_COUNT - 1);
+	return (base + (size_t)(class % SL_COUNT) * (base >> SL_LOG2));
+}
+#else
+static int
+size_class(size_t asize){
+	int class = 0;
+	size_t limit = MINBLOCK;
+
+	while (class < NUM_CLASSES - 1 && asize > limit) {
+		limit <<= 1;
+		class++;
+	}
+	return (class);
+}
+#endif
+
+#if !MM_TLSF
+/*
+ * Requires:
+ * 	The addresses "bp" and "qp" of two free blocks.
+ *
+ * Effects:
+ * 	Returns true if "bp" comes before "qp" in the tree, which is ordered by
+ * 	size and then by address, so that no two nodes have equal keys.
+ */
+static bool
+tree_less(void * bp, void * qp){
+	size_t bsize = GET_SIZE(HDRP(bp));
+	size_t qsize = GET_SIZE(HDRP(qp));
+
+	return (bsize < qsize || (bsize == qsize && (char *)bp < (char *)qp));
+}
+
+/*
+ * Requires:
+ * 	The address "bp" of a tree node and whether to rotate "left".
+ *
+ * Effects:
+ * 	Rotates the subtree rooted at "bp" so that its right child (left
+ * 	rotation) or its left child (right rotation) takes its place.
+ */
+static void
+tree_rotate(void * bp, bool left){
+	char *child = left ? TREE_RIGHT(bp) : TREE_LEFT(bp);
+	char *inner = left ? TREE_LEFT(child) : TREE_RIGHT(child);
+
+	if (left)
+		TREE_RIGHT(bp) = inner;
+	else
+		TREE_LEFT(bp) = inner;
+	if (inner != NULL)
+		TREE_PARENT(inner) = bp;
+	tree_transplant(bp, child);
+	if (left)
+		TREE_LEFT(child) = bp;
+	else
+		TREE_RIGHT(child) = bp;
+	TREE_PARENT(bp) = child;
+}
+
+/*
+ * Requires:
+ * 	The address "bp" of a tree node and "child", which is NULL or a node.
+ *
+ * Effects:
+ * 	Puts "child" in the place of "bp" under the parent of "bp".  The
+ * 	children of "bp" are left unchanged.
+ */
+static void
+tree_transplant(void * bp, void * child){
+	char *parent = TREE_PARENT(bp);
+
+	if (parent == NULL)
+		arena->tree_root = child;
+	else if (TREE_LEFT(parent) == bp)
+		TREE_LEFT(parent) = child;
+	else
+		TREE_RIGHT(parent) = child;
+	if (child != NULL)
+		TREE_PARENT(child) = parent;
+}
+
+/*
+ * Requires:
+ * 	The address "bp" of a free block larger than TREE_MIN.
+ *
+ * Effects:
+ * 	Inserts "bp" into the tree and restores the red-black properties.  The
+ * 	largest node is tracked as it goes in.
+ */
+static void
+tree_insert(void * bp){
+	char *parent = NULL;
+	char *node = arena->tree_root;
+	char *grand, *uncle;
+	bool left;
+
+	while (node != NULL) {
+		parent = node;
+		node = tree_less(bp, node) ? TREE_LEFT(node) : TREE_RIGHT(node);
+	}
+	TREE_LEFT(bp) = NULL;
+	TREE_RIGHT(bp) = NULL;
+	TREE_PARENT(bp) = parent;
+	TREE_COLOR(bp) = RED;
+	if (arena->tree_max == NULL || tree_less(arena->tree_max, bp))
+		arena->tree_max = bp;
+	if (parent == NULL)
+		arena->tree_root = bp;
+	else if (tree_less(bp, parent))
+		TREE_LEFT(parent) = bp;
+	else
+		TREE_RIGHT(parent) = bp;
+
+	/* A red node may not have a red parent. */
+	node = bp;
+	while (IS_RED(parent = TREE_PARENT(node))) {
+		grand = TREE_PARENT(parent);
+		left = (parent == TREE_LEFT(grand));
+		uncle = left ? TREE_RIGHT(grand) : TREE_LEFT(grand);
+		if (IS_RED(uncle)) {
+			/* Push the red up to the grandparent. */
+			TREE_COLOR(parent) = BLACK;
+			TREE_COLOR(uncle) = BLACK;
+			TREE_COLOR(grand) = RED;
+			node = grand;
+			continue;
+		}
+		if (node == (left ? TREE_RIGHT(parent) : TREE_LEFT(parent))) {
+			/* Turn the inner grandchild into an outer one. */
+			tree_rotate(parent, left);
+			node = parent;
+			parent = TREE_PARENT(node);
+		}
+		TREE_COLOR(parent) = BLACK;
+		TREE_COLOR(grand) = RED;
+		tree_rotate(grand, !left);
+	}
+	TREE_COLOR(arena->tree_root) = BLACK;
+}
+
+/*
+ * Requires:
+ * 	The address "bp" of a block in the tree.
+ *
+ * Effects:
+ * 	Removes "bp" from the tree and restores the red-black properties.
+ */
+static void
+tree_remove(void * bp){
+	char *node, *parent, *sibling, *next;
+	uintptr_t removed_color = TREE_COLOR(bp);
+	bool left;
+
+	/* The largest node has no right child, so its left child or else its parent is next. */
+	if (bp == arena->tree_max)
+		arena->tree_max = (TREE_LEFT(bp) != NULL) ? TREE_LEFT(bp) : TREE_PARENT(bp);
+	if (TREE_LEFT(bp) == NULL || TREE_RIGHT(bp) == NULL) {
+		/* At most one child, which takes the place of bp. */
+		node = (TREE_LEFT(bp) != NULL) ? TREE_LEFT(bp) : TREE_RIGHT(bp);
+		parent = TREE_PARENT(bp);
+		tree_transplant(bp, node);
+	} else {
+		/* Two children: the successor of bp takes its place. */
+		for (next = TREE_RIGHT(bp); TREE_LEFT(next) != NULL;
+		    next = TREE_LEFT(next))
+			;
+		removed_color = TREE_COLOR(next);
+		node = TREE_RIGHT(next);
+		if (TREE_PARENT(next) == bp)
+			parent = next;
+		else {
+			parent = TREE_PARENT(next);
+			tree_transplant(next, node);
+			TREE_RIGHT(next) = TREE_RIGHT(bp);
+			TREE_PARENT(TREE_RIGHT(next)) = next;
+		}
+		tree_transplant(bp, next);
+		TREE_LEFT(next) = TREE_LEFT(bp);
+		TREE_PARENT(TREE_LEFT(next)) = next;
+		TREE_COLOR(next) = TREE_COLOR(bp);
+	}
+	if (removed_color == RED)
+		return;
+
+	/* The path through node lost a black node; fix it going up. */
+	while (node != arena->tree_root && !IS_RED(node)) {
+		left = (node == TREE_LEFT(parent));
+		sibling = left ? TREE_RIGHT(parent) : TREE_LEFT(parent);
+		if (IS_RED(sibling)) {
+			TREE_COLOR(sibling) = BLACK;
+			TREE_COLOR(parent) = RED;
+			tree_rotate(parent, left);
+			sibling = left ? TREE_RIGHT(parent) : TREE_LEFT(parent);
+		}
+		if (!IS_RED(TREE_LEFT(sibling)) && !IS_RED(TREE_RIGHT(sibling))) {
+			TREE_COLOR(sibling) = RED;
+			node = parent;
+			parent = TREE_PARENT(node);
+			continue;
+		}
+		if (!IS_RED(left ? TREE_RIGHT(sibling) : TREE_LEFT(sibling))) {
+			/* Make the outer child of the sibling red. */
+			TREE_COLOR(left ? TREE_LEFT(sibling) : TREE_RIGHT(sibling)) = BLACK;
+			TREE_COLOR(sibling) = RED;
+			tree_rotate(sibling, !left);
+			sibling = left ? TREE_RIGHT(parent) : TREE_LEFT(parent);
+		}
+		TREE_COLOR(sibling) = TREE_COLOR(parent);
+		TREE_COLOR(parent) = BLACK;
+		TREE_COLOR(left ? TREE_RIGHT(sibling) : TREE_LEFT(sibling)) = BLACK;
+		tree_rotate(parent, left);
+		node = arena->tree_root;
+	}
+	if (node != NULL)
+		TREE_COLOR(node) = BLACK;
+}
+
+/*
+ * Requires:
+ * 	Size of the block to be found.
+ *
+ * Effects:
+ * 	Returns the smallest block in the tree of at least "asize" bytes, the
+ * 	one at the lowest address among equal sizes, or NULL if there is none.
+ */
+static void *
+tree_best_fit(size_t asize){
+	char *node = arena->tree_root;
+	char *best = NULL;
+
+	while (node != NULL) {
+		PROBE();
+		if (GET_SIZE(HDRP(node)) >= asize) {
+			best = node;
+			node = TREE_LEFT(node);
+		} else
+			node = TREE_RIGHT(node);
+	}
+	return (best);
+}
+#endif
+
+/* 
+ * Requires:
+ * 	A request size "size" greater than zero.
+ * 
+ * Effects:
+ * 	Returns the size of the block needed for a payload of "size" bytes:
+ * 	the payload plus a header, rounded up to a multiple of DSIZE and to at
+ * 	least MINBLOCK, so that the block can hold the list pointers and the
+ * 	footer once it is freed.  Returns 0 if that size does not fit in a
+ * 	size_t, which no heap could satisfy.
+ */
+static size_t
+adjust_size(size_t size){
+	if (size > SIZE_MAX - (WSIZE + DSIZE))
+		return (0);
+	return (MAX(MINBLOCK, DSIZE * ((size + WSIZE + (DSIZE - 1)) / DSIZE)));
+}
+
+/*
+ * Requires:
+ *   "p" and "q" point to block pointers.
+ *
+ * Effects:
+ *   Order block pointers by address for qsort.
+ */
+static int
+ptr_compare(const void *p, const void *q)
+{
+	uintptr_t a = (uintptr_t)*(void * const *)p;
+	uintptr_t b = (uintptr_t)*(void * const *)q;
+
+	return ((a > b) - (a < b));
 }
 
 /* 
  * The remaining routines are heap consistency checker routines. 
  */
 
+/*
+ * Requires:
+ *   A printf format "fmt" and the arguments that it asks for.
+ *
+ * Effects:
+ *   Print a problem that the checker found.  Returns 1, so that callers can
+ *   add the result to their count of problems.
+ */
+static int
+report(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	return (1);
+}
+
 /*
  * Requires:
  *   "bp" is the address of a block.
  *
  * Effects:
- *   Perform a minimal check on the block "bp".
+ *   Perform a minimal check on the block "bp".  Returns the number of
+ *   problems found.
  */
-static void
+static int
 checkblock(void * bp) 
 {
+	int errors = 0;
+
 	if ((uintptr_t)bp % DSIZE)
-		printf("Error: %p is not doubleword aligned\n", bp);
-	if (GET(HDRP(bp)) != GET(FTRP(bp)))
-		printf("Error: header and footer of block %p do not match\n", bp);
-
-	/* To check if the next and prev pointers for free blocks are within heap bounds. */
-	if(GET_ALLOC(bp) == 0)
-		if ((void *)GET_NEXT_PTR(bp) < mem_heap_lo() || (void *)GET_NEXT_PTR(bp) > mem_heap_hi())
-			printf("Error: next pointer %p is not within heap bounds \n", GET_NEXT_PTR(bp));
+		errors += report("Error: %p is not doubleword aligned\n", bp);
+	if (!GET_ALLOC(HDRP(bp)) && (GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp)) ||
+	    GET_ALLOC(FTRP(bp))))
+		errors += report("Error: header and footer of block %p do not match\n", bp);
+	/*
+	 * Only the first and last words of a fresh block are sampled, so that
+	 * the check stays linear in the number of blocks and does not fault in
+	 * pages that were never committed or were given back.
+	 */
+	if (!GET_ALLOC(HDRP(bp)) && GET_FRESH(HDRP(bp)) &&
+	    (char *)bp + NODE_SIZE < FTRP(bp) &&
+	    (GET((char *)bp + NODE_SIZE) != 0 || GET(FTRP(bp) - WSIZE) != 0))
+		errors += report("Error: fresh block %p is not zero\n", bp);
+
+	/* To check if the next and prev pointers for free blocks are within heap bounds.  The top and nodes of the tree hold no list links. */
+#if MM_TLSF
+	if(GET_ALLOC(HDRP(bp)) == 0 && bp != arena->top){
+#else
+	if(GET_ALLOC(HDRP(bp)) == 0 && bp != arena->top && GET_SIZE(HDRP(bp)) <= TREE_MIN){
+#endif
+		if(GET_NEXT_PTR(bp) != NULL)
+			if ((void *)GET_NEXT_PTR(bp) < mem_region_lo(arena->region) || (void *)GET_NEXT_PTR(bp) > mem_region_hi(arena->region))
+				errors += report("Error: next pointer %p is not within heap bounds \n", GET_NEXT_PTR(bp));
 		if(GET_PREV_PTR(bp) != NULL)
-			if ((void *)GET_PREV_PTR(bp) < mem_heap_lo() || (void *)GET_PREV_PTR(bp) > mem_heap_hi())
-				printf("Error: prev pointer %p is not within heap bounds \n", GET_PREV_PTR(bp));
+			if ((void *)GET_PREV_PTR(bp) < mem_region_lo(arena->region) || (void *)GET_PREV_PTR(bp) > mem_region_hi(arena->region))
+				errors += report("Error: prev pointer %p is not within heap bounds \n", GET_PREV_PTR(bp));
+	}
+	return (errors);
 }
 
 /* 
@@ -475,85 +3372,246 @@ checkblock(void * bp)
  *   None.
  *
  * Effects:
- *   Perform a minimal check of the heap for consistency. 
+ *   Check the current arena for consistency, printing every problem found,
+ *   and every block if "verbose".  Returns the number of problems found.
+ *   The check takes time linear in the size of the heap, so that it can
+ *   run after every request of a long trace.  One walk of the heap checks
+ *   every block and counts the free blocks other than the top, and one
+ *   walk of the free lists and the tree checks that every block in them is
+ *   such a block and counts them.  The two counts then agree only if every
+ *   free block but the top is indexed exactly once.
  */
-void
+static int
 checkheap(bool verbose) 
 {
+	char *lo = mem_region_lo(arena->region);
+	char *hi = mem_region_hi(arena->region);
 	void * bp;
+	void * prevp;
+	int class;
+	int errors = 0;
+	unsigned count;
+	size_t free_bytes = 0, free_blocks = 0, blocks = 0;
+	size_t unindexed = 0;  /* Free blocks of the heap, but for the top */
+	size_t indexed = 0;    /* Blocks in the free lists and the tree */
+	size_t class_blocks[MM_STATS_CLASSES] = { 0 };
+#if !MM_TLSF
 	void * bp2;
-	int flag = 0;
+#endif
 
 	if (verbose)
-		printf("Heap (%p):\n", heap_listp);
+		printf("Heap (%p):\n", arena->heap_listp);
 
 	/* Checking prologue */
-	if (GET_SIZE(HDRP(heap_listp)) != 2 * DSIZE || !GET_ALLOC(HDRP(heap_listp)))
-		printf("Bad prologue header\n");
-	checkblock(heap_listp);
-	printblock(heap_listp);
+	if (GET_SIZE(HDRP(arena->heap_listp)) != DSIZE || !GET_ALLOC(HDRP(arena->heap_listp)))
+		errors += report("Bad prologue header\n");
+	errors += checkblock(arena->heap_listp);
+	if (verbose)
+		printblock(arena->heap_listp);
+
+	/* 
+	 * Traversing through heap to check each block.
+	 * We start with the first block after the prologue since the previous block for prologue
+	 * does not exist. Also, prologue has been checked above.  A block whose size
+	 * runs past the end of the heap ends the walk.
+	 */
+	prevp = arena->heap_listp;
+	for(bp = NEXT_BLKP(arena->heap_listp); (char *)bp <= hi && GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+		if (verbose)
+			printblock(bp);
+		errors += checkblock(bp);
+		blocks++;
 
+		/* To check if the previous-allocated bit matches the previous block. */
+		if(!GET_PREV_ALLOC(HDRP(bp)) != !GET_ALLOC(HDRP(prevp)))
+			errors += report("The previous-allocated bit of %p is wrong\n", bp);
+		prevp = bp;
+		if (GET_ALLOC(HDRP(bp)))
+			continue;
 
-	for (bp = free_listp; bp!=heap_listp; bp = GET_NEXT_PTR(bp)) {
-		/* To check if all blocks in free list are indeed free. */
-		if(GET_ALLOC(HDRP(bp))!=0){
-			printf("The allocated block %p has been added to the free list\n", bp);
-		}
+		free_bytes += GET_SIZE(HDRP(bp));
+		free_blocks++;
+		class_blocks[STATS_CLASS(GET_SIZE(HDRP(bp)))]++;
 
 		/* To check coalescing, check if adjacent blocks are allocated. */
-		if(GET_ALLOC(PREV_BLKP(bp))!=1 || GET_ALLOC(NEXT_BLKP(bp))!=1)
-			printf("The free block %p has escaped coalescing\n", bp);
-
-		/* To check if the pointers of the free blocks point to valid free blocks. */
-		if(bp != free_listp){
-			if(GET_ALLOC((uintptr_t *)GET_PREV_PTR(HDRP(bp))) !=0 ){
-				printf("The previous pointer of %p does not point to a free block\n", bp);
-			}
+		if (!GET_PREV_ALLOC(HDRP(bp)) || !GET_ALLOC(HDRP(NEXT_BLKP(bp))))
+			errors += report("The free block %p has escaped coalescing\n", bp);
+
+		/* The top is in no list, and only the last block may be the top. */
+		if (bp == arena->top) {
+			if (GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0)
+				errors += report("The top %p is not the last block\n", bp);
+		} else {
+			if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)
+				errors += report("The free last block %p is not the top\n", bp);
+			unindexed++;
 		}
-		if(GET_ALLOC((uintptr_t *)GET_NEXT_PTR(HDRP(bp)))!=0){
-			printf("The next pointer of %p does not point to a free block\n", bp);
-			}
-	}
-	/* Checking if prologue points to a valid free block. */
-	if(heap_listp != free_listp && GET_ALLOC((uintptr_t *)GET_PREV_PTR(HDRP(heap_listp))) != 0){
-		printf("The previous pointer of prologue %p does not point to a free block\n", heap_listp);
 	}
 
-	/* 
-	 * Traversing through heap to check each block.
-	 * We start with the first block after the prologue since the previous block for prologue
-	 * does not exist. Also, prologue has been checked above. 
-	 */
-	for(bp = NEXT_BLKP(heap_listp) ; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
-		flag=0;
-
+	if ((char *)bp != hi + 1)
+		errors += report("The blocks do not span the heap\n");
+	else {
 		if (verbose)
 			printblock(bp);
-		checkblock(bp);
-	
-		/* 
-		 * To check if all the free blocks have been added to the free list. 
-		 * Traverse the heap. Once you find a free block, find that block in the free list.
-		 * If this was not found, it implies that the free block has not been added.
-		 */
-		if(GET_ALLOC(HDRP(bp))==0){
-			for(bp2 = free_listp; bp2 != heap_listp; bp2 = GET_NEXT_PTR(bp2)){
-				if(bp2 == bp){
-					flag = 1;
-					break;
-				}
+		if (!GET_ALLOC(HDRP(bp)) || !GET_PREV_ALLOC(HDRP(bp)) != !GET_ALLOC(HDRP(prevp)))
+			errors += report("Bad epilogue header\n");
+		if (arena->top != NULL && (GET_ALLOC(HDRP(arena->top)) || NEXT_BLKP(arena->top) != bp))
+			errors += report("The top %p is not the free last block\n", arena->top);
+	}
+
+	/*
+	 * Walking the free lists.  Every block in them must be a free block of
+	 * the heap other than the top, so a list that holds more blocks than
+	 * that must loop, and the walk stops there.
+	 */
+	for (class = 0; class < NUM_CLASSES && indexed <= unindexed; class++) {
+#if MM_TLSF
+		/* To check if the bitmaps agree with the bins. */
+		if ((arena->seg_lists[class] != NULL) !=
+		    ((arena->sl_bitmap[class / SL_COUNT] >> (class % SL_COUNT)) & 1))
+			errors += report("The bitmap bit of bin %d does not match its list\n", class);
+		if ((arena->sl_bitmap[class / SL_COUNT] != 0) !=
+		    ((arena->fl_bitmap >> (class / SL_COUNT)) & 1))
+			errors += report("The first-level bitmap bit of bin %d is wrong\n", class);
+#endif
+		prevp = NULL;
+		for (bp = arena->seg_lists[class]; bp != NULL; bp = GET_NEXT_PTR(bp)) {
+			/* To check if the block lies in the heap before reading it. */
+			if ((char *)bp < lo || (char *)bp > hi || (uintptr_t)bp % DSIZE) {
+				errors += report("The list of class %d leaves the heap at %p\n", class, bp);
+				break;
 			}
-			if(flag == 0)
-				printf("The free block %p has not been added to the free list\n", bp);
+			if (++indexed > unindexed) {
+				errors += report("The list of class %d holds blocks that are not free, or loops\n", class);
+				break;
+			}
+
+			/* To check if all blocks in free list are indeed free. */
+			if(GET_ALLOC(HDRP(bp)) != 0 || bp == arena->top)
+				errors += report("The block %p in the list of class %d is not a free block\n", bp, class);
+
+			/* To check if the block is in the list of its size class. */
+			if(size_class(GET_SIZE(HDRP(bp))) != class)
+				errors += report("The free block %p is in the list of the wrong size class\n", bp);
+
+			/* To check if the previous pointer leads back to the block before. */
+			if(GET_PREV_PTR(bp) != prevp)
+				errors += report("The previous pointer of %p is not the block before it\n", bp);
+			prevp = bp;
 		}
 	}
 
-	if (verbose)
-		printblock(bp);
+#if !MM_TLSF
+	if (IS_RED(arena->tree_root))
+		errors += report("The root of the tree %p is red\n", arena->tree_root);
+	if (arena->tree_root != NULL && TREE_PARENT(arena->tree_root) != NULL)
+		errors += report("The root of the tree %p has a parent\n", arena->tree_root);
+	if (indexed <= unindexed)
+		checktree(arena->tree_root, unindexed, &indexed, &errors);
+	count = 0;
+	for (bp2 = arena->tree_root; bp2 != NULL && TREE_RIGHT(bp2) != NULL &&
+	    count++ < unindexed; bp2 = TREE_RIGHT(bp2))
+		;
+	if (bp2 != arena->tree_max)
+		errors += report("The largest node of the tree is %p, not %p\n", bp2, arena->tree_max);
+#endif
+
+	/* To check if every free block has been added to the free lists or the tree. */
+	if (indexed != unindexed)
+		errors += report("The free lists and the tree hold %zu blocks, not %zu\n", indexed, unindexed);
+
+	for (class = 0; class < CACHE_BINS; class++) {
+		count = 0;
+		for (bp = arena->cache[class]; bp != NULL; bp = CACHE_NEXT(bp)) {
+			/* To check if the cached blocks are allocated blocks of this arena. */
+			if ((char *)bp < lo || (char *)bp > hi) {
+				errors += report("The cached block %p is not within heap bounds\n", bp);
+				break;
+			} else if (!GET_ALLOC(HDRP(bp)))
+				errors += report("The free block %p has been added to the cache\n", bp);
+			else if ((int)CACHE_BIN(GET_SIZE(HDRP(bp))) < class)
+				errors += report("The cached block %p is too small for its bin\n", bp);
+			if (++count > CACHE_LIMIT)
+				break;
+		}
+		if (count != arena->cache_count[class])
+			errors += report("Bin %d of the cache does not hold %u blocks\n", class, arena->cache_count[class]);
+	}
+
+	/* To check the counters that mm_get_stats reports. */
+	if (free_bytes != arena->stats.free_bytes)
+		errors += report("The free blocks hold %zu bytes, not %zu\n", free_bytes, arena->stats.free_bytes);
+	if (free_blocks != arena->stats.free_blocks)
+		errors += report("There are %zu free blocks, not %zu\n", free_blocks, arena->stats.free_blocks);
+	if (blocks != arena->blocks)
+		errors += report("There are %zu blocks, not %zu\n", blocks, arena->blocks);
+	for (class = 0; class < MM_STATS_CLASSES; class++)
+		if (class_blocks[class] != arena->stats.class_blocks[class])
+			errors += report("Class %d of the stats holds %zu free blocks, not %zu\n",
+			    class, class_blocks[class], arena->stats.class_blocks[class]);
+	return (errors);
+}
+
+#if !MM_TLSF
+/*
+ * Requires:
+ *   "bp" is NULL or the address of a node of the tree, "*nodes" is the
+ *   number of blocks found in the free lists and the tree so far, and
+ *   "limit" is the number of blocks that they may hold.
+ *
+ * Effects:
+ *   Check the subtree rooted at "bp": its nodes must be large free blocks
+ *   in key order, their parent pointers must be right and no red node may
+ *   have a red child.  A child that lies outside the heap or does not point
+ *   back to its parent is not descended into, and the walk stops once more
+ *   than "limit" blocks have been found, so that a damaged tree cannot make
+ *   it loop.  Adds the nodes to "*nodes" and the problems to "*errors".
+ *   Returns the black height of the subtree, or -1 if its paths do not all
+ *   hold the same number of black nodes.
+ */
+static int
+checktree(void * bp, size_t limit, size_t *nodes, int *errors)
+{
+	char *lo = mem_region_lo(arena->region);
+	char *hi = mem_region_hi(arena->region);
+	char *left = NULL, *right = NULL;
+	int lheight, rheight;
 
-	if (GET_SIZE(HDRP(bp)) != 0 || !GET_ALLOC(HDRP(bp)))
-		printf("Bad epilogue header\n");
+	if (bp == NULL)
+		return (1);
+	if (++*nodes > limit) {
+		*errors += report("The tree holds blocks that are not free, or loops\n");
+		return (-1);
+	}
+	if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) <= TREE_MIN || bp == arena->top)
+		*errors += report("The block %p in the tree is not a large free block\n", bp);
+	if (TREE_LEFT(bp) != NULL) {
+		if (TREE_LEFT(bp) < lo || TREE_LEFT(bp) > hi || TREE_PARENT(TREE_LEFT(bp)) != bp ||
+		    !tree_less(TREE_LEFT(bp), bp))
+			*errors += report("The left child of tree node %p is wrong\n", bp);
+		else
+			left = TREE_LEFT(bp);
+	}
+	if (TREE_RIGHT(bp) != NULL) {
+		if (TREE_RIGHT(bp) < lo || TREE_RIGHT(bp) > hi || TREE_PARENT(TREE_RIGHT(bp)) != bp ||
+		    !tree_less(bp, TREE_RIGHT(bp)))
+			*errors += report("The right child of tree node %p is wrong\n", bp);
+		else
+			right = TREE_RIGHT(bp);
+	}
+	if (IS_RED(bp) && (IS_RED(left) || IS_RED(right)))
+		*errors += report("The red tree node %p has a red child\n", bp);
+
+	lheight = checktree(left, limit, nodes, errors);
+	rheight = checktree(right, limit, nodes, errors);
+	if (lheight != rheight || lheight < 0) {
+		if (lheight >= 0 && rheight >= 0)
+			*errors += report("The subtrees of tree node %p differ in black height\n", bp);
+		return (-1);
+	}
+	return (lheight + (IS_RED(bp) ? 0 : 1));
 }
+#endif
 
 /*
  * Requires:
@@ -568,21 +3626,19 @@ printblock(void * bp)
 	bool halloc, falloc;
 	size_t hsize, fsize;
 
-	checkheap(false);
 	hsize = GET_SIZE(HDRP(bp));
 	halloc = GET_ALLOC(HDRP(bp));  
-	fsize = GET_SIZE(FTRP(bp));
-	falloc = GET_ALLOC(FTRP(bp));  
-
 	if (hsize == 0) {
 		printf("%p: end of heap\n", bp);
 		return;
 	}
+	fsize = GET_SIZE(FTRP(bp));
+	falloc = GET_ALLOC(FTRP(bp));  
 
 	if(halloc == 1)
-		printf("%p: header: [%zu:%c] footer: [%zu:%c]\n", bp, 
-	    	hsize, (halloc ? 'a' : 'f'), 
-	    	fsize, (falloc ? 'a' : 'f'));
+		printf("%p: header: [%zu:%c%s]\n", bp, 
+	    	hsize, (halloc ? 'a' : 'f'),
+	    	(GET_PREV_ALLOC(HDRP(bp)) ? "" : " prev free"));
 	else
 		printf("%p: header: [%zu:%c] prev_ptr: %p next_ptr: %p footer: [%zu:%c]\n", bp, 
 	    	hsize, (halloc ? 'a' : 'f'), 
@@ -7,6 +7,84 @@ int mm_init(void);
 void *mm_malloc(size_t size);
 void mm_free(void *ptr);
 void *mm_realloc(void *ptr, size_t size);
+int mm_trim(size_t pad);
+size_t mm_malloc_batch(size_t size, size_t n, void **out);
+void mm_free_batch(void **ptrs, size_t n);
+void mm_free_sized(void *ptr, size_t size);
+size_t mm_usable_size(void *ptr);
+void *mm_memalign(size_t alignment, size_t size);
+void *mm_aligned_alloc(size_t alignment, size_t size);
+void *mm_calloc(size_t nmemb, size_t size);
+int mm_checkheap(int verbose);
+
+/* Independent heaps, each with its own region and free lists. */
+typedef struct mm_heap mm_heap_t;
+mm_heap_t *mm_heap_create(void);
+void *mm_heap_malloc(mm_heap_t *heap, size_t size);
+void mm_heap_free(mm_heap_t *heap, void *ptr);
+void *mm_heap_realloc(mm_heap_t *heap, void *ptr, size_t size);
+void mm_heap_destroy(mm_heap_t *heap);
+
+/* Regions of objects that are allocated one by one and freed all at once. */
+typedef struct mm_region mm_region_t;
+mm_region_t *mm_region_create(void);
+void *mm_region_alloc(mm_region_t *region, size_t size);
+void mm_region_reset(mm_region_t *region);
+void mm_region_destroy(mm_region_t *region);
+
+/* Heap growth policies for mm_set_growth. */
+#define MM_GROW_FIXED     0  /* Grow by at least a fixed chunk */
+#define MM_GROW_ADAPTIVE  1  /* Grow by a step that follows demand */
+int mm_set_growth(int policy);
+
+/* Counters of the small-object cache in front of the heap. */
+typedef struct {
+    unsigned long hits;    /* Small mm_malloc requests served from the cache */
+    unsigned long misses;  /* Small mm_malloc requests that refilled the cache */
+    unsigned long frees;   /* mm_free requests that put a block in the cache */
+    unsigned long flushes; /* Times a full bin gave blocks back to the heap */
+} mm_cache_stats_t;
+
+void mm_get_cache_stats(mm_cache_stats_t *stats);
+
+/* Number of size classes in mm_stats_t; class i holds 2^(i+4) bytes and up. */
+#define MM_STATS_CLASSES 16
+
+/* Counters of the heap, kept up to date as blocks change. */
+typedef struct {
+    size_t heap_bytes;         /* Bytes of heap, including the overhead */
+    size_t alloc_bytes;        /* Bytes in allocated and cached blocks */
+    size_t alloc_blocks;       /* Allocated and cached blocks */
+    size_t free_bytes;         /* Bytes in free blocks */
+    size_t free_blocks;        /* Free blocks */
+    size_t largest_free;       /* Size of the largest free block (TLSF: a lower bound) */
+    size_t mapped_bytes;       /* Bytes in blocks with mappings of their own */
+    size_t mapped_blocks;      /* Blocks with mappings of their own */
+    size_t class_blocks[MM_STATS_CLASSES]; /* Free blocks in each size class */
+    unsigned long splits;      /* Blocks split in two or more */
+    unsigned long coalesces;   /* Blocks merged with a neighbour */
+    unsigned long grows;       /* Times the heap grew */
+    unsigned long shrinks;     /* Times the heap shrank */
+    unsigned long releases;    /* Times free pages were given back */
+} mm_stats_t;
+
+void mm_get_stats(mm_stats_t *stats);
+
+/* Buckets of the probe histogram: 0, 1, 2, 3-4, 5-8, 9-16, 17-32, 33+ blocks. */
+#define MM_PROBE_BINS 8
+
+/* Counters of the hot paths, kept only when mm.c is built with MM_INSTRUMENT. */
+typedef struct {
+    unsigned long probes[MM_PROBE_BINS]; /* Fit searches by blocks visited */
+    unsigned long coalesce[4];    /* Merges with no, next, prev, both neighbours */
+    unsigned long place_split;    /* Placements that split the free block */
+    unsigned long place_whole;    /* Placements that used the whole free block */
+    unsigned long realloc_inplace; /* Reallocations that kept the block in place */
+    unsigned long realloc_slid;   /* Reallocations that slid into the block before */
+    unsigned long realloc_copied; /* Reallocations that copied to a new block */
+} mm_instrument_t;
+
+int mm_get_instrument(mm_instrument_t *stats);
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, personal
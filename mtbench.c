@@ -0,0 +1,279 @@
+/*
+ * mtbench.c - Multithreaded throughput benchmark for mm.c
+ *
+ * Runs a producer/consumer workload with 1, 2, ... up to N threads and
+ * reports the throughput and the speedup over one thread for each count.
+ * The threads form a ring: every thread allocates small blocks, hands a
+ * share of them to the next thread through a single-producer,
+ * single-consumer queue, and frees the blocks that the previous thread
+ * hands to it.  With the multithreaded build of mm.c (MM_THREADS=1), every
+ * block that crosses the ring is a remote free.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define MAXTHREADS  64    /* most threads that can be asked for */
+#define RINGSIZE    1024  /* blocks in flight between two threads */
+#define MINSIZE     16    /* smallest request (bytes) */
+#define MAXSIZE     256   /* largest request (bytes) */
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* A single-producer, single-consumer queue of blocks */
+typedef struct {
+    void *slots[RINGSIZE];
+    unsigned long head __attribute__((aligned(64))); /* next slot to take */
+    unsigned long tail __attribute__((aligned(64))); /* next slot to fill */
+} ring_t;
+
+/* The allocator being measured */
+typedef struct {
+    char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+} allocator_t;
+
+/* Holds the params to one worker thread */
+typedef struct {
+    int id;
+    int nthreads;
+    allocator_t *alloc;
+} worker_t;
+
+/********************
+ * Global variables
+ *******************/
+static ring_t rings[MAXTHREADS];  /* rings[i] carries blocks from thread i */
+static long iters = 200000;       /* allocations per thread */
+static int remote_pct = 50;       /* share of blocks freed by the next thread */
+static pthread_barrier_t start;   /* lines the workers up before timing */
+
+/*********************
+ * Function prototypes
+ *********************/
+static void *worker(void *arg);
+static double run(allocator_t *alloc, int nthreads);
+static void printresults(allocator_t *alloc, int maxthreads);
+static double now(void);
+static void *libc_malloc(size_t size);
+static void libc_free(void *ptr);
+static void usage(void);
+static void app_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c;
+    int maxthreads = 4;  /* most threads to run (set by -t) */
+    int run_libc = 0;    /* If set, run libc malloc (set by -l) */
+    allocator_t mm = { "mm", mm_malloc, mm_free };
+    allocator_t libc = { "libc", libc_malloc, libc_free };
+
+    while ((c = getopt(argc, argv, "t:n:r:lh")) != EOF) {
+        switch (c) {
+        case 't': /* Most threads to run */
+            maxthreads = atoi(optarg);
+            if (maxthreads < 1 || maxthreads > MAXTHREADS)
+                app_error("mtbench: thread count out of range");
+            break;
+        case 'n': /* Allocations per thread */
+            iters = atol(optarg);
+            if (iters < 1)
+                app_error("mtbench: allocation count out of range");
+            break;
+        case 'r': /* Percentage of blocks freed by the next thread */
+            remote_pct = atoi(optarg);
+            if (remote_pct < 0 || remote_pct > 100)
+                app_error("mtbench: remote percentage out of range");
+            break;
+        case 'l': /* Run libc malloc */
+            run_libc = 1;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    /* Initialize the simulated memory system in memlib.c */
+    mem_init();
+
+    if (run_libc)
+        printresults(&libc, maxthreads);
+    printresults(&mm, maxthreads);
+    return 0;
+}
+
+/*
+ * printresults - runs the workload with 1 to maxthreads threads and
+ *    prints the throughput of each run
+ */
+static void printresults(allocator_t *alloc, int maxthreads)
+{
+    int n;
+    double secs, kops, base = 0;
+
+    printf("\nResults for %s malloc (%d%% remote frees):\n",
+           alloc->name, remote_pct);
+    printf("%7s%10s%10s%9s\n", "threads", "secs", "Kops", "speedup");
+    for (n = 1; n <= maxthreads; n++) {
+        /* Every thread makes one malloc and about one free per iteration */
+        secs = run(alloc, n);
+        kops = 2.0 * iters * n / secs / 1e3;
+        if (n == 1)
+            base = kops;
+        printf("%7d%10.6f%10.0f%9.2f\n", n, secs, kops, kops / base);
+    }
+}
+
+/*
+ * run - runs the workload with nthreads threads and returns the wall
+ *    clock time, in seconds, from their start to the end of the last one
+ */
+static double run(allocator_t *alloc, int nthreads)
+{
+    pthread_t tids[MAXTHREADS];
+    worker_t params[MAXTHREADS];
+    double t0;
+    void *p;
+    int i;
+
+    /* Every run starts from empty heaps */
+    mem_reset_brk();
+    if (alloc->malloc == mm_malloc && mm_init() < 0)
+        app_error("mm_init failed in run");
+    memset(rings, 0, sizeof(rings));
+
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+    for (i = 0; i < nthreads; i++) {
+        params[i].id = i;
+        params[i].nthreads = nthreads;
+        params[i].alloc = alloc;
+        if (pthread_create(&tids[i], NULL, worker, &params[i]) != 0)
+            app_error("pthread_create failed in run");
+    }
+    pthread_barrier_wait(&start);
+    t0 = now();
+    for (i = 0; i < nthreads; i++)
+        pthread_join(tids[i], NULL);
+    t0 = now() - t0;
+    pthread_barrier_destroy(&start);
+
+    /* Free the blocks that were still in flight */
+    for (i = 0; i < nthreads; i++) {
+        while (rings[i].head != rings[i].tail) {
+            p = rings[i].slots[rings[i].head % RINGSIZE];
+            alloc->free(p);
+            rings[i].head++;
+        }
+    }
+    return t0;
+}
+
+/*
+ * worker - the body of one thread: allocate, pass blocks on to the next
+ *    thread and free the blocks passed on by the previous one
+ */
+static void *worker(void *arg)
+{
+    worker_t *w = arg;
+    ring_t *out = &rings[w->id];
+    ring_t *in = &rings[(w->id + w->nthreads - 1) % w->nthreads];
+    unsigned seed = w->id + 1;
+    unsigned long head, tail;
+    unsigned char *p;
+    size_t size;
+    long i;
+
+    pthread_barrier_wait(&start);
+    for (i = 0; i < iters; i++) {
+        size = MINSIZE + rand_r(&seed) % (MAXSIZE - MINSIZE + 1);
+        if ((p = w->alloc->malloc(size)) == NULL)
+            app_error("malloc failed in worker");
+        p[0] = p[size - 1] = (unsigned char)w->id;
+
+        /* Hand the block on, or free it here if it stays local */
+        tail = out->tail;
+        if ((int)(rand_r(&seed) % 100) < remote_pct &&
+            tail - __atomic_load_n(&out->head, __ATOMIC_ACQUIRE) < RINGSIZE) {
+            out->slots[tail % RINGSIZE] = p;
+            __atomic_store_n(&out->tail, tail + 1, __ATOMIC_RELEASE);
+        } else
+            w->alloc->free(p);
+
+        /* Free one block handed on by the previous thread */
+        head = in->head;
+        if (head != __atomic_load_n(&in->tail, __ATOMIC_ACQUIRE)) {
+            p = in->slots[head % RINGSIZE];
+            __atomic_store_n(&in->head, head + 1, __ATOMIC_RELEASE);
+            w->alloc->free(p);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * now - returns the time on a monotonic clock, in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * libc_malloc, libc_free - the libc allocator, for comparison
+ */
+static void *libc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void libc_free(void *ptr)
+{
+    free(ptr);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtbench [-hl] [-t <n>] [-n <n>] [-r <pct>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-n <n>     Allocations per thread (default 200000).\n");
+    fprintf(stderr, "\t-r <pct>   Percentage of blocks freed by another thread (default 50).\n");
+    fprintf(stderr, "\t-t <n>     Run with 1 to <n> threads (default 4).\n");
+}
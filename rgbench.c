@@ -0,0 +1,284 @@
+/*
+ * rgbench.c - Region allocation benchmark for mm.c
+ *
+ * Runs a request-scoped workload: every request allocates a number of
+ * small objects, writes to them, and then drops all of them at once.  The
+ * same workload, with the same sizes, is run with a free of every object
+ * (mm_malloc and mm_free), with one mm_free_batch of all the objects of a
+ * request, and with a region (mm_region_alloc and one mm_region_reset per
+ * request), and the throughput of the fastest of RUNS runs and the heap
+ * size of each are reported, along with whether the frees of mm_free_batch
+ * kept up with those of mm_free.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define MAXOBJECTS  100000  /* most objects that a request can ask for */
+#define MINSIZE     8       /* smallest object (bytes) */
+#define MAXSIZE     256     /* largest object (bytes) */
+#define RUNS        5       /* runs of each method, of which the fastest counts */
+#define NOISE       0.03    /* timing noise allowed when comparing methods */
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* One way of serving the objects of a request */
+typedef struct {
+    char *name;
+    double (*run)(void);
+} method_t;
+
+/********************
+ * Global variables
+ *******************/
+static long requests = 2000;          /* requests to run */
+static int objects = 1000;            /* objects per request */
+static size_t sizes[MAXOBJECTS];      /* object sizes, the same for every method */
+static void *ptrs[MAXOBJECTS];        /* objects of the current request */
+static double freesecs;               /* time spent freeing, in the last run */
+
+/*********************
+ * Function prototypes
+ *********************/
+static double run_free(void);
+static double run_batch(void);
+static double run_region(void);
+static double run_libc(void);
+static double printresult(method_t *method, double base);
+static double now(void);
+static void usage(void);
+static void app_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c, i;
+    int run_libc_too = 0; /* If set, run libc malloc (set by -l) */
+    unsigned seed = 1;
+    double secs[3], frees[2];
+    method_t methods[] = {
+        { "mm_free", run_free },
+        { "mm_free_batch", run_batch },
+        { "mm_region", run_region },
+    };
+    method_t libc = { "libc free", run_libc };
+
+    while ((c = getopt(argc, argv, "n:k:lh")) != EOF) {
+        switch (c) {
+        case 'n': /* Requests to run */
+            requests = atol(optarg);
+            if (requests < 1)
+                app_error("rgbench: request count out of range");
+            break;
+        case 'k': /* Objects per request */
+            objects = atoi(optarg);
+            if (objects < 1 || objects > MAXOBJECTS)
+                app_error("rgbench: object count out of range");
+            break;
+        case 'l': /* Run libc malloc */
+            run_libc_too = 1;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < objects; i++)
+        sizes[i] = MINSIZE + rand_r(&seed) % (MAXSIZE - MINSIZE + 1);
+
+    /* Initialize the simulated memory system in memlib.c */
+    mem_init();
+
+    printf("\n%ld requests of %d objects of %d to %d bytes:\n",
+           requests, objects, MINSIZE, MAXSIZE);
+    printf("%-14s%10s%10s%9s%10s\n", "method", "secs", "Kops", "speedup", "heap");
+    for (i = 0; i < (int)(sizeof(methods) / sizeof(methods[0])); i++) {
+        secs[i] = printresult(&methods[i], i == 0 ? 0 : secs[0]);
+        if (i < 2)
+            frees[i] = freesecs;
+    }
+    if (run_libc_too)
+        printresult(&libc, secs[0]);
+
+    /* Freeing a batch should never cost more than freeing its objects one by one */
+    printf("\nfreeing with mm_free_batch is %s with mm_free (%.2fx)\n",
+           frees[1] <= frees[0] * (1 + NOISE) ? "at least as fast as" : "SLOWER than",
+           frees[0] / frees[1]);
+    return 0;
+}
+
+/*
+ * printresult - runs the workload RUNS times with one method and prints
+ *    the throughput of the fastest run, its speedup over "base" seconds
+ *    (none if 0) and the peak size of the heap; returns the time of the
+ *    fastest run
+ */
+static double printresult(method_t *method, double base)
+{
+    double secs = 0, frees = 0, t;
+    int i;
+
+    for (i = 0; i < RUNS; i++) {
+        mem_reset_brk();
+        if (mm_init() < 0)
+            app_error("mm_init failed in printresult");
+        freesecs = 0;
+        t = method->run();
+        if (i == 0 || t < secs)
+            secs = t;
+        if (i == 0 || freesecs < frees)
+            frees = freesecs;
+    }
+    freesecs = frees;
+    printf("%-14s%10.6f%10.0f%9.2f%10lu\n", method->name, secs,
+           2.0 * requests * objects / secs / 1e3, base > 0 ? base / secs : 1.0,
+           method->run == run_libc ? 0 : (unsigned long)mem_peak_heapsize());
+    return secs;
+}
+
+/*
+ * run_free - allocates the objects of every request with mm_malloc and
+ *    frees them one by one with mm_free, adds the time of the frees to
+ *    freesecs, and returns the time it took
+ */
+static double run_free(void)
+{
+    double t0 = now(), t1;
+    long r;
+    int i;
+
+    for (r = 0; r < requests; r++) {
+        for (i = 0; i < objects; i++) {
+            if ((ptrs[i] = mm_malloc(sizes[i])) == NULL)
+                app_error("mm_malloc failed in run_free");
+            memset(ptrs[i], i, sizes[i]);
+        }
+        t1 = now();
+        for (i = 0; i < objects; i++)
+            mm_free(ptrs[i]);
+        freesecs += now() - t1;
+    }
+    return now() - t0;
+}
+
+/*
+ * run_batch - allocates the objects of every request with mm_malloc and
+ *    frees them all with one mm_free_batch, adds the time of the frees to
+ *    freesecs, and returns the time it took
+ */
+static double run_batch(void)
+{
+    double t0 = now(), t1;
+    long r;
+    int i;
+
+    for (r = 0; r < requests; r++) {
+        for (i = 0; i < objects; i++) {
+            if ((ptrs[i] = mm_malloc(sizes[i])) == NULL)
+                app_error("mm_malloc failed in run_batch");
+            memset(ptrs[i], i, sizes[i]);
+        }
+        t1 = now();
+        mm_free_batch(ptrs, objects);
+        freesecs += now() - t1;
+    }
+    return now() - t0;
+}
+
+/*
+ * run_region - allocates the objects of every request from a region and
+ *    drops them all with one mm_region_reset, and returns the time it took
+ */
+static double run_region(void)
+{
+    double t0 = now();
+    mm_region_t *region;
+    long r;
+    int i;
+
+    if ((region = mm_region_create()) == NULL)
+        app_error("mm_region_create failed in run_region");
+    for (r = 0; r < requests; r++) {
+        for (i = 0; i < objects; i++) {
+            if ((ptrs[i] = mm_region_alloc(region, sizes[i])) == NULL)
+                app_error("mm_region_alloc failed in run_region");
+            memset(ptrs[i], i, sizes[i]);
+        }
+        mm_region_reset(region);
+    }
+    mm_region_destroy(region);
+    return now() - t0;
+}
+
+/*
+ * run_libc - the workload of run_free with the libc allocator, for
+ *    comparison
+ */
+static double run_libc(void)
+{
+    double t0 = now();
+    long r;
+    int i;
+
+    for (r = 0; r < requests; r++) {
+        for (i = 0; i < objects; i++) {
+            if ((ptrs[i] = malloc(sizes[i])) == NULL)
+                app_error("malloc failed in run_libc");
+            memset(ptrs[i], i, sizes[i]);
+        }
+        for (i = 0; i < objects; i++)
+            free(ptrs[i]);
+    }
+    return now() - t0;
+}
+
+/*
+ * now - returns the time on a monotonic clock, in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: rgbench [-hl] [-n <n>] [-k <n>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-k <n>     Objects per request (default 1000).\n");
+    fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-n <n>     Requests to run (default 2000).\n");
+}